@@ -0,0 +1,66 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <NN.h>
+
+/*
+	compare NNload and NNload_fast on a model file
+
+	usage: load <model> [threads] [rounds]
+
+	a multi-million-edge model shows the difference, e.g. 256 inputs, 2048 hidden vertices fully connected to them and to each other in a few layers, 16 outputs
+*/
+
+double now(void);
+
+int main(int argc, char ** argv) {
+
+	unsigned int threads = (argc > 2) ? (unsigned int)atoi(argv[2]) : 4, rounds = (argc > 3) ? (unsigned int)atoi(argv[3]) : 3, v = 0, e = 0, i;
+	double t, slow = 0, fast = 0;
+	struct NNetwork * a, * b;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <model> [threads] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < rounds; i++) {
+		t = now();
+		if ((a = NNload(argv[1])) == NULL) {
+			perror("NNload");
+			return 1;
+		}
+		slow += now() - t;
+
+		t = now();
+		if ((b = NNload_fast(argv[1], threads)) == NULL) {
+			perror("NNload_fast");
+			return 1;
+		}
+		fast += now() - t;
+
+		if ((NNsize(a) != NNsize(b)) || memcmp(a, b, NNsize(a))) {
+			fprintf(stderr, "NNload_fast differs from NNload\n");
+			return 1;
+		}
+
+		v = a -> vertices, e = a -> edges;
+		NNfree(a), NNfree(b);
+	}
+
+	printf("%u vertices, %u edges\n", v, e);
+	printf("NNload:      %.3lf s\n", slow / rounds);
+	printf("NNload_fast: %.3lf s (%u threads, %.1lfx)\n", fast / rounds, threads, slow / fast);
+
+	return 0;
+}
+
+double now(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
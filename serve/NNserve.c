@@ -0,0 +1,516 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <NN.h>
+
+#include "NNserve.h"
+
+#define NN_BUCKETS 24
+
+
+struct NNjob;
+struct NNmodel;
+struct NNconn;
+
+struct NNjob {
+	unsigned int count;
+	const double * inputs;
+	double * outputs;
+	double start;
+	bool done;
+	struct NNjob * next;
+};
+
+struct NNmodel {
+	const char * file;
+	const struct NNetwork * network;
+	struct NNplan * plan;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t ready, done;
+	struct NNjob * head, ** tail;
+	size_t queued;
+	unsigned long long requests, samples, batches, histogram[NN_BUCKETS];
+};
+
+struct NNconn {
+	int fd;
+};
+
+
+static void * NNbatcher(void * arg);
+static void * NNconnection(void * arg);
+
+static int NNsubmit(struct NNmodel * model, struct NNjob * job);
+static void NNreport(FILE * stream, double elapsed);
+
+static int read_full(int fd, void * buf, size_t size);
+static int write_full(int fd, const void * buf, size_t size);
+
+static double NNnow(void);
+static void NNstop(int sig);
+
+
+static struct NNmodel * models;
+static unsigned int model_count, max_batch = 256;
+static double max_wait = 0.0005;
+static volatile sig_atomic_t quit = 0;
+
+
+/*
+	a daemon serving predictions of one or more models over a Unix domain socket
+
+	usage: NNserve [-s socket] [-w max_wait_us] [-b max_batch] [-r report_seconds] model ...
+
+	note: a model is mapped read-only if it is in the binary format (see NNmap), so processes serving the same file share its pages, and parsed by NNload otherwise. Every connection is served by its own thread, which hands each request to the batcher thread of its model and waits. The batcher coalesces the requests queued within max_wait of the oldest one (or until max_batch samples are queued) into one NNpredict_plan_batch call. The throughput and a latency histogram (power of 2 buckets of microseconds, from queueing to completion) of each model are written to stderr every report_seconds and on SIGINT/SIGTERM.
+*/
+
+int main(int argc, char ** argv) {
+
+	const char * path = NN_SERVE_SOCKET;
+	int opt, fd = -1, client;
+	unsigned int i, report = 10;
+	double begin, last;
+
+	struct sockaddr_un addr;
+	struct sigaction action;
+	struct pollfd listener;
+	struct NNconn * conn;
+	pthread_t thread;
+
+	while ((opt = getopt(argc, argv, "s:w:b:r:")) != -1) {
+		switch (opt) {
+			case 's' :
+				path = optarg;
+				break;
+			case 'w' :
+				max_wait = atof(optarg) / 1e6;
+				break;
+			case 'b' :
+				max_batch = (unsigned int)atoi(optarg);
+				break;
+			case 'r' :
+				report = (unsigned int)atoi(optarg);
+				break;
+			default :
+				goto usage;
+		}
+	}
+
+	if ((optind >= argc) || (max_batch == 0) || (strlen(path) >= sizeof(addr.sun_path)))
+		goto usage;
+
+	model_count = argc - optind;
+
+	if ((models = calloc(model_count, sizeof(struct NNmodel))) == NULL)
+		goto fail;
+
+	for (i = 0; i < model_count; i++) {
+		models[i].file = argv[optind + i];
+
+		if (((models[i].network = NNmap(argv[optind + i])) == NULL) && ((models[i].network = NNload(argv[optind + i])) == NULL)) {
+			fprintf(stderr, "NNserve: can not load %s\n", argv[optind + i]);
+			goto fail;
+		}
+
+		if ((models[i].plan = NNcompile(models[i].network)) == NULL)
+			goto fail;
+
+		models[i].head = NULL,
+		models[i].tail = &models[i].head;
+
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+		pthread_mutex_init(&models[i].lock, NULL);
+		pthread_cond_init(&models[i].ready, &attr);
+		pthread_cond_init(&models[i].done, NULL);
+		pthread_condattr_destroy(&attr);
+
+		if (pthread_create(&models[i].thread, NULL, & NNbatcher, models + i))
+			goto fail;
+
+		fprintf(stderr, "NNserve: model %u: %s (%u inputs, %u outputs)\n", i, models[i].file, models[i].plan -> inputs, models[i].plan -> outputs);
+	}
+
+	memset(&action, 0, sizeof(action));
+	sigemptyset(&action.sa_mask);
+
+	action.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &action, NULL);
+
+	action.sa_handler = & NNstop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		goto fail;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, SOMAXCONN))
+		goto fail;
+
+	fprintf(stderr, "NNserve: listening on %s\n", path);
+
+	listener.fd = fd, listener.events = POLLIN;
+	begin = last = NNnow();
+
+	while (!quit) {
+		if (poll(&listener, 1, 1000) > 0) {
+			if ((client = accept(fd, NULL, NULL)) == -1)
+				continue;
+
+			if ((conn = malloc(sizeof(struct NNconn))) == NULL) {
+				close(client);
+				continue;
+			}
+
+			conn -> fd = client;
+
+			if (pthread_create(&thread, NULL, & NNconnection, conn)) {
+				close(client);
+				free(conn);
+				continue;
+			}
+
+			pthread_detach(thread);
+		}
+
+		if (report && (NNnow() - last >= report)) {
+			last = NNnow();
+			NNreport(stderr, last - begin);
+		}
+	}
+
+	close(fd);
+	unlink(path);
+	NNreport(stderr, NNnow() - begin);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s socket] [-w max_wait_us] [-b max_batch] [-r report_seconds] model ...\n", argv[0]);
+	return 2;
+
+fail:
+	perror("NNserve");
+
+	if (fd != -1)
+		close(fd);
+
+	return 1;
+}
+
+
+/*
+	the thread forming and running the micro-batches of one model
+
+	arg -- the NNmodel to serve
+*/
+
+void * NNbatcher(void * arg) {
+
+	struct NNmodel * model = arg;
+	unsigned int ins = model -> plan -> inputs, outs = model -> plan -> outputs, bucket;
+	size_t size, capacity = 0, n;
+	double * inputs = NULL, * outputs = NULL, deadline, latency, now;
+	void * p;
+
+	struct NNjob * batch, * job, ** last;
+	struct timespec until;
+
+	pthread_mutex_lock(&model -> lock);
+
+	while (1) {
+		while (model -> head == NULL)
+			pthread_cond_wait(&model -> ready, &model -> lock);
+
+		deadline = model -> head -> start + max_wait;
+		until.tv_sec = (time_t)deadline, until.tv_nsec = (long)((deadline - (time_t)deadline) * 1e9);
+
+		while (model -> queued < max_batch)
+			if (pthread_cond_timedwait(&model -> ready, &model -> lock, &until) == ETIMEDOUT)
+				break;
+
+		for (batch = model -> head, last = &batch, size = 0; (* last != NULL) && ((size == 0) || (size + (* last) -> count <= max_batch)); last = &(* last) -> next)
+			size += (* last) -> count;
+
+		model -> head = * last, * last = NULL;
+		if (model -> head == NULL)
+			model -> tail = &model -> head;
+		model -> queued -= size;
+
+		pthread_mutex_unlock(&model -> lock);
+
+		if (size > capacity) {
+			if ((p = realloc(inputs, size * ins * sizeof(double))) != NULL)
+				inputs = p;
+			if ((p != NULL) && ((p = realloc(outputs, size * outs * sizeof(double))) != NULL))
+				outputs = p, capacity = size;
+		}
+
+		if (size <= capacity) {
+			for (job = batch, n = 0; job != NULL; n += job -> count, job = job -> next)
+				memcpy(inputs + n * ins, job -> inputs, job -> count * ins * sizeof(double));
+
+			if (NNpredict_plan_batch(model -> plan, inputs, size, outputs) == -1)
+				size = 0;
+
+			for (job = batch, n = 0; (size > 0) && (job != NULL); n += job -> count, job = job -> next)
+				memcpy(job -> outputs, outputs + n * outs, job -> count * outs * sizeof(double));
+		}
+
+		pthread_mutex_lock(&model -> lock);
+
+		for (job = batch, now = NNnow(); job != NULL; job = job -> next) {
+			latency = (now - job -> start) * 1e6;
+			for (bucket = 0; (bucket < NN_BUCKETS - 1) && (latency >= (double)(2u << bucket)); bucket++);
+
+			model -> histogram[bucket]++;
+			model -> requests++;
+			job -> done = true;
+
+			if ((size == 0) || (size > capacity))
+				job -> count = 0;
+		}
+
+		model -> samples += size, model -> batches++;
+		pthread_cond_broadcast(&model -> done);
+	}
+
+	return NULL;
+}
+
+
+/*
+	the thread serving one client connection
+
+	arg -- the NNconn of the connection, freed on exit
+*/
+
+void * NNconnection(void * arg) {
+
+	struct NNconn * conn = arg;
+	int fd = conn -> fd;
+	size_t capacity = 0, need;
+	double * buf = NULL;
+	void * p;
+
+	struct NNserve_request request;
+	struct NNserve_response response;
+	struct NNmodel * model;
+	struct NNjob job;
+
+	free(conn);
+
+	while (read_full(fd, &request, sizeof(request)) == 0) {
+
+		response.count = 0, response.inputs = 0, response.outputs = 0;
+
+		if (request.model >= model_count) {
+			response.status = NN_SERVE_NO_MODEL;
+			write_full(fd, &response, sizeof(response));
+			break;
+		}
+
+		model = models + request.model;
+		response.inputs = model -> plan -> inputs, response.outputs = model -> plan -> outputs;
+
+		if (request.count > NN_SERVE_MAX) {
+			response.status = NN_SERVE_TOO_LARGE;
+			write_full(fd, &response, sizeof(response));
+			break;
+		}
+
+		need = request.count * (size_t)(response.inputs + response.outputs);
+
+		if (need > capacity) {
+			if ((p = realloc(buf, need * sizeof(double))) == NULL) {
+				response.status = NN_SERVE_FAILED;
+				write_full(fd, &response, sizeof(response));
+				break;
+			}
+
+			buf = p, capacity = need;
+		}
+
+		if (read_full(fd, buf, request.count * (size_t)response.inputs * sizeof(double)))
+			break;
+
+		job.count = request.count,
+		job.inputs = buf,
+		job.outputs = buf + request.count * (size_t)response.inputs;
+
+		if ((request.count > 0) && NNsubmit(model, &job)) {
+			response.status = NN_SERVE_FAILED;
+			write_full(fd, &response, sizeof(response));
+			break;
+		}
+
+		response.status = NN_SERVE_OK, response.count = request.count;
+
+		if (write_full(fd, &response, sizeof(response)) || write_full(fd, job.outputs, request.count * (size_t)response.outputs * sizeof(double)))
+			break;
+	}
+
+	close(fd);
+
+	if (buf != NULL)
+		free(buf);
+
+	return NULL;
+}
+
+
+/*
+	queue a job to the batcher of a model and wait for it
+
+	model -- the model to run the job
+	job -- the job, with count, inputs and outputs set
+
+	return 0 on success, -1 on failed
+*/
+
+int NNsubmit(struct NNmodel * model, struct NNjob * job) {
+
+	unsigned int count = job -> count;
+
+	pthread_mutex_lock(&model -> lock);
+
+	job -> start = NNnow(),
+	job -> done = false,
+	job -> next = NULL;
+
+	* model -> tail = job,
+	model -> tail = &job -> next;
+	model -> queued += count;
+
+	pthread_cond_signal(&model -> ready);
+
+	while (!job -> done)
+		pthread_cond_wait(&model -> done, &model -> lock);
+
+	pthread_mutex_unlock(&model -> lock);
+
+	return (job -> count == count) ? 0 : -1;
+}
+
+
+/*
+	write the throughput and latency histogram of every model
+
+	stream -- where to write
+	elapsed -- the seconds since serving started
+*/
+
+void NNreport(FILE * stream, double elapsed) {
+
+	unsigned int i, j;
+	unsigned long long requests, samples, batches, histogram[NN_BUCKETS];
+
+	for (i = 0; i < model_count; i++) {
+		pthread_mutex_lock(&models[i].lock);
+		requests = models[i].requests, samples = models[i].samples, batches = models[i].batches;
+		memcpy(histogram, models[i].histogram, sizeof(histogram));
+		pthread_mutex_unlock(&models[i].lock);
+
+		fprintf(stream, "model %u: %llu requests, %llu samples, %llu batches (%.1f samples/batch), %.1f requests/s, %.1f samples/s\n", i, requests, samples, batches, batches ? (double)samples / batches : 0.0, requests / elapsed, samples / elapsed);
+
+		for (j = 0; j < NN_BUCKETS; j++)
+			if (histogram[j])
+				fprintf(stream, "\t< %8u us: %llu\n", 2u << j, histogram[j]);
+	}
+
+	return;
+}
+
+
+/*
+	read exactly size bytes
+
+	return 0 on success, -1 on end of file or error
+*/
+
+int read_full(int fd, void * buf, size_t size) {
+
+	ssize_t got;
+	char * p = buf;
+
+	while (size > 0) {
+		if ((got = read(fd, p, size)) <= 0) {
+			if ((got == -1) && (errno == EINTR))
+				continue;
+			return -1;
+		}
+
+		p += got, size -= got;
+	}
+
+	return 0;
+}
+
+
+/*
+	write exactly size bytes
+
+	return 0 on success, -1 on error
+*/
+
+int write_full(int fd, const void * buf, size_t size) {
+
+	ssize_t put;
+	const char * p = buf;
+
+	while (size > 0) {
+		if ((put = write(fd, p, size)) <= 0) {
+			if ((put == -1) && (errno == EINTR))
+				continue;
+			return -1;
+		}
+
+		p += put, size -= put;
+	}
+
+	return 0;
+}
+
+
+/*
+	the seconds of the monotonic clock
+*/
+
+double NNnow(void) {
+
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/*
+	the handler of SIGINT and SIGTERM
+*/
+
+void NNstop(int sig) {
+
+	(void)sig;
+	quit = 1;
+}
@@ -0,0 +1,38 @@
+#ifndef __NNSERVE_H
+#define __NNSERVE_H
+
+#include <stdint.h>
+
+#define NN_SERVE_SOCKET "/tmp/NNserve.sock"
+#define NN_SERVE_MAX 65536
+
+#define NN_SERVE_OK 0
+#define NN_SERVE_NO_MODEL -1
+#define NN_SERVE_TOO_LARGE -2
+#define NN_SERVE_FAILED -3
+
+
+/*
+	the framing of NNserve, all fields in host byte order (the socket never leaves the host)
+
+	a request is a struct NNserve_request followed by count * inputs doubles, the samples of the request in the form double[count][inputs]
+	a response is a struct NNserve_response followed by count * outputs doubles if status is NN_SERVE_OK
+
+	model -- the index of the model, in the order the files are given to NNserve
+	count -- the number of samples, 0 to only query inputs and outputs of the model, no more than NN_SERVE_MAX
+	status -- NN_SERVE_OK on success, a negative NN_SERVE_* code otherwise, the connection is closed after an error
+	inputs -- the inputs of each sample of the model
+	outputs -- the outputs of each sample of the model
+*/
+
+struct NNserve_request {
+	uint32_t model, count;
+};
+
+struct NNserve_response {
+	int32_t status;
+	uint32_t inputs, outputs, count;
+};
+
+
+#endif
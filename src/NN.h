@@ -3,6 +3,17 @@
 
 #include "NN/train.h"
 #include "NN/predict.h"
+#include "NN/binary.h"
+#include "NN/parse.h"
+#include "NN/checkpoint.h"
+#include "NN/state.h"
+#include "NN/dataset.h"
+#include "NN/stream.h"
+#include "NN/plan.h"
+#include "NN/csr.h"
+#include "NN/pool.h"
+#include "NN/f32.h"
+#include "NN/quant.h"
 
 int NNdebug = 0;
 
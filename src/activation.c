@@ -9,6 +9,14 @@ NNActiv activ_table[] = { NN_ACTS };
 NNActiv d_activ_table[] = { NN_ACTS };
 #undef X
 
+#define X(f) &f ## _n,
+NNActivN activ_n_table[] = { NN_ACTS };
+#undef X
+
+#define X(f) &f ## _nf,
+NNActivNF activ_nf_table[] = { NN_ACTS };
+#undef X
+
 double identity(double x) {
 	
 	return x;
@@ -51,6 +59,54 @@ double d_relu(double x) {
 	return 0.000003;
 }
 
+/*
+	the array versions of the activation functions, y[i] = f(x[i]) for i < n, the _nf ones work in single precision
+
+	note: these are written branch free so that the compiler may vectorize them
+*/
+
+NN_SIMD void identity_n(size_t n, const double * x, double * y) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		y[i] = x[i];
+}
+
+NN_SIMD void arctan_n(size_t n, const double * x, double * y) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		y[i] = x[i] / (1 + (x[i] < 0 ? -x[i] : x[i]));
+}
+
+NN_SIMD void relu_n(size_t n, const double * x, double * y) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		y[i] = x[i] > -1.0 ? x[i] : -1;
+}
+
+NN_SIMD void identity_nf(size_t n, const float * x, float * y) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		y[i] = x[i];
+}
+
+NN_SIMD void arctan_nf(size_t n, const float * x, float * y) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		y[i] = x[i] / (1 + (x[i] < 0 ? -x[i] : x[i]));
+}
+
+NN_SIMD void relu_nf(size_t n, const float * x, float * y) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		y[i] = x[i] > -1.0f ? x[i] : -1;
+}
+
 unsigned int get_activ_index(NNActiv f) {
 
 #define X(g) if (f == &g) return _ ## g;
@@ -1,7 +1,17 @@
 #ifndef __ACTIVATION_H
 #define __ACTIVATION_H
 
+#include <stddef.h>
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define NN_SIMD __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define NN_SIMD
+#endif
+
 typedef double (* NNActiv)(double);
+typedef void (* NNActivN)(size_t n, const double * x, double * y);
+typedef void (* NNActivNF)(size_t n, const float * x, float * y);
 
 #define NN_ACTS \
 	X(identity) \
@@ -9,7 +19,7 @@ typedef double (* NNActiv)(double);
 	X(relu)
 
 #define X(f) _ ## f,
-enum activ_index { NN_ACTS };
+enum activ_index { NN_ACTS NN_ACTIVS };
 #undef X
 
 #define X(f) double f(double x);
@@ -20,10 +30,22 @@ NN_ACTS
 NN_ACTS
 #undef X
 
+#define X(f) void f ## _n(size_t n, const double * x, double * y);
+NN_ACTS
+#undef X
+
+#define X(f) void f ## _nf(size_t n, const float * x, float * y);
+NN_ACTS
+#undef X
+
 extern NNActiv activ_table[];
 
 extern NNActiv d_activ_table[];
 
+extern NNActivN activ_n_table[];
+
+extern NNActivNF activ_nf_table[];
+
 unsigned int get_activ_index(NNActiv f);
 
 #endif
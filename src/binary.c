@@ -0,0 +1,457 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "binary.h"
+#include "iter.h"
+
+#define NN_BIN_CHUNK 256
+#define NN_BIN_PRIME 0x100000001b3ULL
+
+
+extern int NNdebug;
+
+
+static bool NNbin_valid(const struct NNetwork * network);
+static bool NNlittle_endian(void);
+
+
+/*
+	save the neural network in the binary format
+
+	network -- the neural network to save, it is only read
+	file -- the filename of the binary model (pathname)
+
+	return 0 on success, -1 on failure. errno set by fclose > NNwrite_bin > fopen
+
+	note: the file is a struct NNbin_header followed by the image of the network blob (struct NNetwork, the vertices, then the edges), little-endian and bit-exact. Every vertex and edge is saved, flagged edges included, the padding is zeroed, map is saved as NN_NIL and schedule as NULL. checksum covers the image.
+*/
+
+int NNsave_bin(const struct NNetwork * network, const char * file) {
+
+	FILE * fp = NULL;
+
+	if ((fp = fopen(file, "wb")) == NULL)
+		goto fail;
+
+	if (NNwrite_bin(network, fp) == -1)
+		goto fail;
+
+	if (fclose(fp) == EOF) {
+		fp = NULL;
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	if (fp != NULL)
+		fclose(fp);
+
+	return -1;
+}
+
+
+/*
+	write the neural network in the binary format at the position of a stream, as NNsave_bin
+
+	network -- the neural network to write, it is only read
+	fp -- the stream to write to, it must be seekable
+
+	return 0 on success, -1 on failure. errno set by fseek > fwrite > ftell, ENOTSUP on a big-endian host
+
+	note: the stream is left at the end of the model, so other data may follow it
+*/
+
+int NNwrite_bin(const struct NNetwork * network, FILE * fp) {
+
+	struct NNbin_header header;
+	struct NNetwork head;
+	unsigned char buffer[NN_BIN_CHUNK * (sizeof(struct NNvertex) > sizeof(struct NNedge) ? sizeof(struct NNvertex) : sizeof(struct NNedge))];
+
+	unsigned int v = network -> vertices, e = network -> edges, i, j, n;
+	uint64_t hash = NN_BIN_SEED;
+	long offset;
+
+	const struct NNvertex * vertices = (const void *)network -> contents;
+	const struct NNedge * edges = (const void *)(vertices + v);
+	struct NNvertex * vertex = (void *)buffer;
+	struct NNedge * edge = (void *)buffer;
+
+	if (!NNlittle_endian()) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NN_BIN_MAGIC, sizeof(header.magic));
+	header.version = NN_BIN_VERSION,
+	header.endian = NN_BIN_ENDIAN,
+	header.vertex_size = sizeof(struct NNvertex),
+	header.edge_size = sizeof(struct NNedge),
+	header.size = NNsize(network);
+
+	if ((offset = ftell(fp)) == -1)
+		return -1;
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		return -1;
+
+	memset(&head, 0, sizeof(head));
+	head.inputs = network -> inputs,
+	head.outputs = network -> outputs,
+	head.vertices = v,
+	head.edges = e,
+	head.schedule = NULL;
+
+	hash = NNchecksum(hash, &head, sizeof(head));
+	if (fwrite(&head, sizeof(head), 1, fp) != 1)
+		return -1;
+
+	for (i = 0; i < v; i += n) {
+		n = (v - i < NN_BIN_CHUNK) ? v - i : NN_BIN_CHUNK;
+		memset(buffer, 0, n * sizeof(struct NNvertex));
+
+		for (j = 0; j < n; j++)
+			vertex[j].layer_index = vertices[i + j].layer_index,
+			vertex[j].activ_index = vertices[i + j].activ_index,
+			vertex[j].value = vertices[i + j].value,
+			vertex[j].output = vertices[i + j].output,
+			vertex[j].d_output = vertices[i + j].d_output,
+			vertex[j].derivative = vertices[i + j].derivative,
+			vertex[j].nuance = vertices[i + j].nuance,
+			vertex[j].count = vertices[i + j].count,
+			vertex[j].edges[NN_FORWARD] = vertices[i + j].edges[NN_FORWARD],
+			vertex[j].edges[NN_BACKWARD] = vertices[i + j].edges[NN_BACKWARD],
+			vertex[j].map = NN_NIL;
+
+		hash = NNchecksum(hash, buffer, n * sizeof(struct NNvertex));
+		if (fwrite(buffer, sizeof(struct NNvertex), n, fp) != n)
+			return -1;
+	}
+
+	for (i = 0; i < e; i += n) {
+		n = (e - i < NN_BIN_CHUNK) ? e - i : NN_BIN_CHUNK;
+		memset(buffer, 0, n * sizeof(struct NNedge));
+
+		for (j = 0; j < n; j++)
+			edge[j].flag = edges[i + j].flag,
+			edge[j].weight = edges[i + j].weight,
+			edge[j].value = edges[i + j].value,
+			edge[j].derivative = edges[i + j].derivative,
+			edge[j].nuance = edges[i + j].nuance,
+			edge[j].count = edges[i + j].count,
+			edge[j].vertices[NN_FORWARD] = edges[i + j].vertices[NN_FORWARD],
+			edge[j].vertices[NN_BACKWARD] = edges[i + j].vertices[NN_BACKWARD],
+			edge[j].next[NN_FORWARD] = edges[i + j].next[NN_FORWARD],
+			edge[j].next[NN_BACKWARD] = edges[i + j].next[NN_BACKWARD];
+
+		hash = NNchecksum(hash, buffer, n * sizeof(struct NNedge));
+		if (fwrite(buffer, sizeof(struct NNedge), n, fp) != n)
+			return -1;
+	}
+
+	header.checksum = hash;
+
+	if (fseek(fp, offset, SEEK_SET) == -1)
+		return -1;
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		return -1;
+
+	if (fseek(fp, 0, SEEK_END) == -1)
+		return -1;
+
+	return 0;
+}
+
+
+/*
+	read a neural network in the binary format from the position of a stream
+
+	fp -- the stream to read from
+
+	return the pointer to neural network on success, NULL on failure. errno set by malloc, EINVAL if the data is short or not a valid binary model of this build
+
+	note: the network is checked as NNmap checks it, the stream is left at the end of the model. Free it with NNfree.
+*/
+
+struct NNetwork * NNread_bin(FILE * fp) {
+
+	struct NNbin_header header;
+	struct NNetwork * network = NULL;
+
+	if (fread(&header, sizeof(header), 1, fp) != 1)
+		goto invalid;
+
+	if (memcmp(header.magic, NN_BIN_MAGIC, sizeof(header.magic)) || (header.version != NN_BIN_VERSION) || (header.endian != NN_BIN_ENDIAN) ||
+		(header.vertex_size != sizeof(struct NNvertex)) || (header.edge_size != sizeof(struct NNedge)) || (header.size < sizeof(struct NNetwork)) || (header.size > SIZE_MAX))
+		goto invalid;
+
+	if ((network = malloc(header.size)) == NULL)
+		return NULL;
+
+	if (fread(network, header.size, 1, fp) != 1)
+		goto invalid;
+
+	if ((NNsize(network) != header.size) || (NNchecksum(NN_BIN_SEED, network, header.size) != header.checksum) || !NNbin_valid(network))
+		goto invalid;
+
+	return network;
+
+invalid:
+	if (network != NULL)
+		free(network);
+
+	errno = EINVAL;
+	return NULL;
+}
+
+
+/*
+	map a binary model read-only
+
+	file -- the filename of the binary model (pathname)
+
+	return the neural network inside the mapping on success, NULL on failure. errno set by mmap > fstat > open, EINVAL if the file is not a valid binary model of this build
+
+	note: nothing is parsed or copied, the pages are shared with the page cache and with every other process mapping the same file. The network is read-only: it serves NNget_ctx, NNcompile, NNget_csr and NNsave_bin, use NNload_bin for a network to train or to pass to NNpredict. The header, the checksum and every link are checked before the network is returned. Release it with NNunmap, never NNfree.
+*/
+
+const struct NNetwork * NNmap(const char * file) {
+
+	int fd = -1;
+	struct stat st;
+	void * map = MAP_FAILED;
+	size_t size = 0;
+
+	const struct NNbin_header * header;
+	const struct NNetwork * network;
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+		goto fail;
+
+	if (fstat(fd, &st) == -1)
+		goto fail;
+
+	if ((size_t)st.st_size < sizeof(struct NNbin_header) + sizeof(struct NNetwork)) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	size = st.st_size;
+
+	if ((map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		goto fail;
+
+	close(fd), fd = -1;
+
+	header = map, network = (const void *)(header + 1);
+
+	if (memcmp(header -> magic, NN_BIN_MAGIC, sizeof(header -> magic)) || (header -> version != NN_BIN_VERSION) || (header -> endian != NN_BIN_ENDIAN) ||
+		(header -> vertex_size != sizeof(struct NNvertex)) || (header -> edge_size != sizeof(struct NNedge)) || (header -> size != size - sizeof(struct NNbin_header)) ||
+		(NNsize(network) != header -> size) ||
+		(NNchecksum(NN_BIN_SEED, network, header -> size) != header -> checksum) || !NNbin_valid(network)) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	return network;
+
+fail:
+	if (map != MAP_FAILED)
+		munmap(map, size);
+
+	if (fd != -1)
+		close(fd);
+
+	return NULL;
+}
+
+
+/*
+	release a network mapped by NNmap
+
+	network -- the network returned by NNmap
+*/
+
+void NNunmap(const struct NNetwork * network) {
+
+	const struct NNbin_header * header = (const struct NNbin_header *)(const void *)network - 1;
+
+	munmap((void *)header, sizeof(struct NNbin_header) + header -> size);
+	return;
+}
+
+
+/*
+	load a binary model into memory
+
+	file -- the filename of the binary model (pathname)
+
+	return the pointer to neural network on success, NULL on failure. errno set as NNmap, or by malloc
+
+	note: the network is a private copy of the image, as NNload returns, free it with NNfree
+*/
+
+struct NNetwork * NNload_bin(const char * file) {
+
+	const struct NNetwork * map;
+	struct NNetwork * network;
+
+	if ((map = NNmap(file)) == NULL)
+		return NULL;
+
+	if ((network = malloc(NNsize(map))) != NULL)
+		memcpy(network, map, NNsize(map));
+
+	NNunmap(map);
+
+	return network;
+}
+
+
+/*
+	convert a text model to a binary model
+
+	text -- the filename of the text model to read
+	bin -- the filename of the binary model to write
+
+	return 0 on success, -1 on failure. errno set as NNsave_bin or NNload
+*/
+
+int NNconvert_text(const char * text, const char * bin) {
+
+	struct NNetwork * network;
+	int ret;
+
+	if ((network = NNload((char *)text)) == NULL)
+		return -1;
+
+	ret = NNsave_bin(network, bin);
+	NNfree(network);
+
+	return ret;
+}
+
+
+/*
+	convert a binary model to a text model
+
+	bin -- the filename of the binary model to read
+	text -- the filename of the text model to write
+
+	return 0 on success, -1 on failure. errno set as NNsave or NNload_bin
+
+	note: the text format keeps the edges reached by a backward traversal only (see NNsave), and prints weights with %lf
+*/
+
+int NNconvert_bin(const char * bin, const char * text) {
+
+	struct NNetwork * network;
+	int ret;
+
+	if ((network = NNload_bin(bin)) == NULL)
+		return -1;
+
+	ret = NNsave(network, text);
+	NNfree(network);
+
+	return ret;
+}
+
+
+/*
+	hash a buffer for the checksum of the binary format
+
+	hash -- the hash of the data before
+	data -- the data to hash
+	size -- the size of data, a multiple of 8 except for the last call
+
+	return the hash including data
+
+	note: FNV-1a over 64-bit little-endian words, folded after each word
+*/
+
+uint64_t NNchecksum(uint64_t hash, const void * data, size_t size) {
+
+	const unsigned char * p = data;
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy(&word, p + i, 8);
+		hash = (hash ^ word) * NN_BIN_PRIME;
+		hash ^= hash >> 32;
+	}
+
+	for (; i < size; i++)
+		hash = (hash ^ p[i]) * NN_BIN_PRIME;
+
+	return hash;
+}
+
+
+/*
+	check that every link of a network image stays inside it
+
+	network -- the network image to check
+
+	return true if the image is safe to traverse
+
+	note: the edge lists of every vertex are walked too, each edge must name the vertex whose list it is in. So an edge is in one list a direction at most and a list running in a cycle is caught within e steps.
+*/
+
+bool NNbin_valid(const struct NNetwork * network) {
+
+	unsigned int v = network -> vertices, e = network -> edges, i, k, steps;
+	int d;
+
+	const struct NNvertex * vertices = (const void *)network -> contents;
+	const struct NNedge * edges = (const void *)(vertices + v);
+
+	if ((network -> schedule != NULL) || (v < (size_t)network -> inputs + network -> outputs + 1))
+		return false;
+
+	for (i = 0; i < v; i++) {
+		if ((vertices[i].activ_index < 0) || (vertices[i].activ_index >= NN_ACTIVS))
+			return false;
+
+		for (d = 0; d < 2; d++)
+			if ((vertices[i].edges[d] != NN_NIL) && (vertices[i].edges[d] >= e))
+				return false;
+	}
+
+	for (i = 0; i < e; i++)
+		for (d = 0; d < 2; d++)
+			if ((edges[i].vertices[d] >= v) || ((edges[i].next[d] != NN_NIL) && (edges[i].next[d] >= e)))
+				return false;
+
+	for (d = 0; d < 2; d++)
+		for (i = 0, steps = 0; i < v; i++)
+			for (k = vertices[i].edges[d]; k != NN_NIL; k = edges[k].next[d])
+				if ((++steps > e) || (edges[k].vertices[!d] != i))
+					return false;
+
+	return true;
+}
+
+
+/*
+	check whether the host is little-endian
+*/
+
+bool NNlittle_endian(void) {
+
+	const uint32_t word = NN_BIN_ENDIAN;
+
+	return *(const unsigned char *)&word == 0x04;
+}
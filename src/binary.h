@@ -0,0 +1,39 @@
+#ifndef __BINARY_H
+#define __BINARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "model.h"
+
+#define NN_BIN_MAGIC "NNbinary"
+#define NN_BIN_VERSION 1
+#define NN_BIN_ENDIAN 0x01020304
+#define NN_BIN_SEED 0xcbf29ce484222325ULL
+
+
+struct NNbin_header;
+
+struct NNbin_header {
+	char magic[8];
+	uint32_t version, endian, vertex_size, edge_size;
+	uint64_t size, checksum;
+	uint8_t reserved[24];
+};
+
+int NNsave_bin(const struct NNetwork * network, const char * file);
+struct NNetwork * NNload_bin(const char * file);
+
+int NNwrite_bin(const struct NNetwork * network, FILE * fp);
+struct NNetwork * NNread_bin(FILE * fp);
+
+const struct NNetwork * NNmap(const char * file);
+void NNunmap(const struct NNetwork * network);
+
+uint64_t NNchecksum(uint64_t hash, const void * data, size_t size);
+
+int NNconvert_text(const char * text, const char * bin);
+int NNconvert_bin(const char * bin, const char * text);
+
+
+#endif
@@ -0,0 +1,370 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "checkpoint.h"
+#include "binary.h"
+#include "state.h"
+
+#define NN_MODEL 0
+#define NN_STATE 1
+
+
+extern int NNdebug;
+
+
+struct NNsnapshot {
+	struct NNetwork * network, * backup;
+	struct NNstate state;
+};
+
+struct NNcheckpoint {
+	char * file[2], * temp[2];
+	int stages, count, error;
+	double seconds, mark;
+	bool quit;
+	struct NNsnapshot * pending[2];
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t thread;
+};
+
+static int NNcheckpoint_give(struct NNcheckpoint * checkpoint, int kind, struct NNsnapshot * snapshot);
+static void * NNcheckpoint_writer(void * arg);
+static int NNcheckpoint_write(const struct NNcheckpoint * checkpoint, int kind, const struct NNsnapshot * snapshot);
+static void NNsnapshot_free(struct NNsnapshot * snapshot);
+static double NNclock(void);
+
+
+/*
+	start a background writer of checkpoints
+
+	file -- the filename of the model checkpoint (pathname), written in the binary format, NULL for none
+	state -- the filename of the training state checkpoint (pathname, see NNsave_state), NULL for none
+	stages -- a checkpoint is due every this many stages, 0 to ignore
+	seconds -- a checkpoint is due when this many seconds passed since the last one, 0 to ignore
+
+	return the checkpointer on success, NULL on failed (OOM or the thread can not be created)
+
+	note: the writer saves to file.tmp then renames it over file, so file is always whole, the last one written. Load a model with NNload_bin, or NNconvert_bin it to text, and a state with NNload_state or NNresume.
+*/
+
+struct NNcheckpoint * NNcheckpoint_start(const char * file, const char * state, int stages, double seconds) {
+
+	struct NNcheckpoint * checkpoint = NULL;
+	const char * name[2] = {file, state};
+	size_t length[2], size = sizeof(struct NNcheckpoint);
+	char * p;
+	int kind;
+
+	for (kind = 0; kind < 2; kind++)
+		if (name[kind] != NULL)
+			length[kind] = strlen(name[kind]), size += 2 * length[kind] + sizeof(".tmp") + 1;
+
+	if ((checkpoint = malloc(size)) == NULL)
+		return NULL;
+
+	for (kind = 0, p = (char *)(checkpoint + 1); kind < 2; kind++) {
+		checkpoint -> file[kind] = NULL, checkpoint -> temp[kind] = NULL, checkpoint -> pending[kind] = NULL;
+
+		if (name[kind] == NULL)
+			continue;
+
+		checkpoint -> file[kind] = p, p += length[kind] + 1;
+		checkpoint -> temp[kind] = p, p += length[kind] + sizeof(".tmp");
+
+		memcpy(checkpoint -> file[kind], name[kind], length[kind] + 1);
+		memcpy(checkpoint -> temp[kind], name[kind], length[kind]);
+		memcpy(checkpoint -> temp[kind] + length[kind], ".tmp", sizeof(".tmp"));
+	}
+
+	checkpoint -> stages = stages,
+	checkpoint -> count = 0,
+	checkpoint -> error = 0,
+	checkpoint -> seconds = seconds,
+	checkpoint -> mark = NNclock(),
+	checkpoint -> quit = false;
+
+	if (pthread_mutex_init(&checkpoint -> lock, NULL))
+		goto fail_lock;
+
+	if (pthread_cond_init(&checkpoint -> wake, NULL))
+		goto fail_wake;
+
+	if (pthread_create(&checkpoint -> thread, NULL, & NNcheckpoint_writer, checkpoint))
+		goto fail;
+
+	return checkpoint;
+
+fail:
+	pthread_cond_destroy(&checkpoint -> wake);
+fail_wake:
+	pthread_mutex_destroy(&checkpoint -> lock);
+fail_lock:
+	free(checkpoint);
+	return NULL;
+}
+
+
+/*
+	wait for the checkpoints in flight and stop the writer
+
+	checkpoint -- the checkpointer to stop, it is freed
+
+	return 0 if every checkpoint was written, -1 if one failed. errno set as the first failed write (NNsave_bin or NNsave_state, fsync or rename)
+*/
+
+int NNcheckpoint_stop(struct NNcheckpoint * checkpoint) {
+
+	int error;
+
+	pthread_mutex_lock(&checkpoint -> lock);
+	checkpoint -> quit = true;
+	pthread_cond_signal(&checkpoint -> wake);
+	pthread_mutex_unlock(&checkpoint -> lock);
+
+	pthread_join(checkpoint -> thread, NULL);
+
+	error = checkpoint -> error;
+
+	pthread_cond_destroy(&checkpoint -> wake);
+	pthread_mutex_destroy(&checkpoint -> lock);
+	free(checkpoint);
+
+	if (error) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+	count a finished stage, and tell whether a checkpoint is due
+
+	checkpoint -- the checkpointer
+
+	return true if a checkpoint is due, the count of stages and the clock start over then
+*/
+
+bool NNcheckpoint_due(struct NNcheckpoint * checkpoint) {
+
+	double now = NNclock();
+
+	checkpoint -> count++;
+
+	if (((checkpoint -> stages <= 0) || (checkpoint -> count < checkpoint -> stages)) && ((checkpoint -> seconds <= 0) || (now - checkpoint -> mark < checkpoint -> seconds)))
+		return false;
+
+	checkpoint -> count = 0,
+	checkpoint -> mark = now;
+
+	return true;
+}
+
+
+/*
+	checkpoint the network now
+
+	checkpoint -- the checkpointer
+	network -- the network to save
+
+	return 0 on success (nothing is done without a model file), -1 on failed (OOM)
+
+	note: the caller only pays for NNcopy, the writer saves the copy while training goes on. A copy still waiting for the writer is replaced, so the file lags at most one write behind.
+*/
+
+int NNcheckpoint_post(struct NNcheckpoint * checkpoint, struct NNetwork * network) {
+
+	struct NNsnapshot * snapshot;
+
+	if (checkpoint -> file[NN_MODEL] == NULL)
+		return 0;
+
+	if ((snapshot = calloc(1, sizeof(struct NNsnapshot))) == NULL)
+		return -1;
+
+	if ((snapshot -> network = NNcopy(network)) == NULL) {
+		free(snapshot);
+		return -1;
+	}
+
+	return NNcheckpoint_give(checkpoint, NN_MODEL, snapshot);
+}
+
+
+/*
+	checkpoint the state of the training now, as NNcheckpoint_post
+
+	checkpoint -- the checkpointer
+	state -- the state of the training
+	network -- the network to train in the next stage
+	backup -- the network of the last stage kept by the training, NULL if none
+
+	return 0 on success (nothing is done without a state file), -1 on failed (OOM)
+*/
+
+int NNcheckpoint_state(struct NNcheckpoint * checkpoint, const struct NNstate * state, struct NNetwork * network, struct NNetwork * backup) {
+
+	struct NNsnapshot * snapshot;
+
+	if (checkpoint -> file[NN_STATE] == NULL)
+		return 0;
+
+	if ((snapshot = calloc(1, sizeof(struct NNsnapshot))) == NULL)
+		return -1;
+
+	snapshot -> state = * state;
+
+	if (((snapshot -> network = NNcopy(network)) == NULL) || ((backup != NULL) && ((snapshot -> backup = NNcopy(backup)) == NULL))) {
+		NNsnapshot_free(snapshot);
+		return -1;
+	}
+
+	return NNcheckpoint_give(checkpoint, NN_STATE, snapshot);
+}
+
+
+/*
+	hand a snapshot to the writer
+
+	checkpoint -- the checkpointer
+	kind -- NN_MODEL or NN_STATE
+	snapshot -- the snapshot, owned by the writer from now on
+
+	return 0
+*/
+
+int NNcheckpoint_give(struct NNcheckpoint * checkpoint, int kind, struct NNsnapshot * snapshot) {
+
+	struct NNsnapshot * stale;
+
+	pthread_mutex_lock(&checkpoint -> lock);
+	stale = checkpoint -> pending[kind];
+	checkpoint -> pending[kind] = snapshot;
+	pthread_cond_signal(&checkpoint -> wake);
+	pthread_mutex_unlock(&checkpoint -> lock);
+
+	if (stale != NULL)
+		NNsnapshot_free(stale);
+
+	return 0;
+}
+
+
+/*
+	the writer thread of a checkpointer
+
+	arg -- the checkpointer
+
+	note: the writer sleeps until a snapshot is given, and writes every snapshot given before NNcheckpoint_stop
+*/
+
+void * NNcheckpoint_writer(void * arg) {
+
+	struct NNcheckpoint * checkpoint = arg;
+	struct NNsnapshot * snapshot;
+	int error, kind;
+
+	pthread_mutex_lock(&checkpoint -> lock);
+
+	while (true) {
+		while ((checkpoint -> pending[NN_MODEL] == NULL) && (checkpoint -> pending[NN_STATE] == NULL) && !checkpoint -> quit)
+			pthread_cond_wait(&checkpoint -> wake, &checkpoint -> lock);
+
+		kind = (checkpoint -> pending[NN_MODEL] != NULL) ? NN_MODEL : NN_STATE;
+
+		if ((snapshot = checkpoint -> pending[kind]) == NULL)
+			break;
+
+		checkpoint -> pending[kind] = NULL;
+		pthread_mutex_unlock(&checkpoint -> lock);
+
+		error = (NNcheckpoint_write(checkpoint, kind, snapshot) == -1) ? errno : 0;
+		NNsnapshot_free(snapshot);
+
+		pthread_mutex_lock(&checkpoint -> lock);
+		if (error && !checkpoint -> error)
+			checkpoint -> error = error;
+	}
+
+	pthread_mutex_unlock(&checkpoint -> lock);
+
+	return NULL;
+}
+
+
+/*
+	write one checkpoint atomically
+
+	checkpoint -- the checkpointer
+	kind -- NN_MODEL or NN_STATE
+	snapshot -- the snapshot to save
+
+	return 0 on success, -1 on failed. errno set by rename > fsync > open > NNsave_bin or NNsave_state
+*/
+
+int NNcheckpoint_write(const struct NNcheckpoint * checkpoint, int kind, const struct NNsnapshot * snapshot) {
+
+	int fd;
+
+	if (kind == NN_MODEL) {
+		if (NNsave_bin(snapshot -> network, checkpoint -> temp[kind]) == -1)
+			return -1;
+	} else {
+		if (NNsave_state(checkpoint -> temp[kind], &snapshot -> state, snapshot -> network, snapshot -> backup) == -1)
+			return -1;
+	}
+
+	if ((fd = open(checkpoint -> temp[kind], O_RDONLY)) == -1)
+		return -1;
+
+	if (fsync(fd) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+
+	return rename(checkpoint -> temp[kind], checkpoint -> file[kind]);
+}
+
+
+/*
+	free a snapshot and its copies
+*/
+
+void NNsnapshot_free(struct NNsnapshot * snapshot) {
+
+	if (snapshot -> network != NULL)
+		NNfree(snapshot -> network);
+
+	if (snapshot -> backup != NULL)
+		NNfree(snapshot -> backup);
+
+	free(snapshot);
+	return;
+}
+
+
+/*
+	read the monotonic clock in seconds
+*/
+
+double NNclock(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
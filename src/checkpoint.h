@@ -0,0 +1,21 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <stdbool.h>
+
+#include "model.h"
+#include "state.h"
+
+
+struct NNcheckpoint;
+
+
+struct NNcheckpoint * NNcheckpoint_start(const char * file, const char * state, int stages, double seconds);
+int NNcheckpoint_stop(struct NNcheckpoint * checkpoint);
+
+bool NNcheckpoint_due(struct NNcheckpoint * checkpoint);
+int NNcheckpoint_post(struct NNcheckpoint * checkpoint, struct NNetwork * network);
+int NNcheckpoint_state(struct NNcheckpoint * checkpoint, const struct NNstate * state, struct NNetwork * network, struct NNetwork * backup);
+
+
+#endif
@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "csr.h"
+#include "plan.h"
+#include "iter.h"
+
+
+extern int NNdebug;
+
+
+/*
+	build the compact adjacency of the neural network
+
+	network -- the neural network to index, it is only read
+
+	return the adjacency on success, NULL if OOM
+
+	note: the incoming edges of every vertex are packed as CSR rows (in_start[i] .. in_start[i + 1]) and the outgoing edges as CSC columns (out_start[i] .. out_start[i + 1]), both with 32-bit vertex indices and in the order of the edge array. Flagged edges are left out. order holds the vertices other than the bias and the inputs in topological order. The adjacency is a snapshot of the topology: weights and edge statistics are copied in by NNcsr_load and back by NNcsr_store, any structural change requires a new one.
+
+	note: the adjacency is a structure-of-arrays layout of the whole network, hot and cold data apart: the forward pass reads only in_start, in_source and in_weight (12 bytes per edge) and writes value, output and d_output, while the edge statistics (nuance, count), the backward topology and the vertex derivatives and statistics stay in their own arrays until a backward pass needs them. No struct NNvertex or NNedge is touched while propagating.
+*/
+
+struct NNcsr * NNget_csr(const struct NNetwork * network) {
+
+	unsigned int inputs = network -> inputs, v = network -> vertices, e = network -> edges, s = v - inputs - 1, n = 0, i, j, k;
+
+	const struct NNvertex * vertices = (const void *)network -> contents, ** order = NULL;
+	const struct NNedge * edges = (const void *)(vertices + v);
+	struct NNcsr * csr = NULL;
+
+	for (i = 0; i < e; i++)
+		if (!edges[i].flag)
+			n++;
+
+	if ((order = malloc((s + 1) * sizeof(struct NNvertex *))) == NULL)
+		goto fail;
+
+	if ((csr = malloc(sizeof(struct NNcsr) + (4 * (size_t)n + 6 * (size_t)v) * sizeof(double) + 2 * (size_t)v * sizeof(NNActiv) + (4 * (size_t)n + 2 * ((size_t)v + 1) + s) * sizeof(unsigned int))) == NULL)
+		goto fail;
+
+	csr -> inputs = inputs,
+	csr -> outputs = network -> outputs,
+	csr -> vertices = v,
+	csr -> edges = n,
+	csr -> steps = s;
+
+	csr -> in_weight = (void *)csr -> contents,
+	csr -> out_weight = csr -> in_weight + n,
+	csr -> nuance = csr -> out_weight + n,
+	csr -> count = csr -> nuance + n;
+
+	csr -> value = csr -> count + n,
+	csr -> output = csr -> value + v,
+	csr -> d_output = csr -> output + v,
+	csr -> derivative = csr -> d_output + v,
+	csr -> vertex_nuance = csr -> derivative + v,
+	csr -> vertex_count = csr -> vertex_nuance + v;
+
+	csr -> activate = (void *)(csr -> vertex_count + v),
+	csr -> d_activate = csr -> activate + v;
+
+	csr -> in_start = (void *)(csr -> d_activate + v),
+	csr -> in_source = csr -> in_start + v + 1,
+	csr -> in_edge = csr -> in_source + n,
+	csr -> out_start = csr -> in_edge + n,
+	csr -> out_target = csr -> out_start + v + 1,
+	csr -> out_edge = csr -> out_target + n,
+	csr -> order = csr -> out_edge + n;
+
+	for (i = 0; i <= v; i++)
+		csr -> in_start[i] = 0, csr -> out_start[i] = 0;
+
+	for (i = 0; i < v; i++)
+		csr -> activate[i] = activ_table[vertices[i].activ_index],
+		csr -> d_activate[i] = d_activ_table[vertices[i].activ_index];
+
+	for (i = 0; i < e; i++) {
+		if (edges[i].flag)
+			continue;
+
+		csr -> in_start[edges[i].vertices[NN_FORWARD] + 1]++,
+		csr -> out_start[edges[i].vertices[NN_BACKWARD] + 1]++;
+	}
+
+	for (i = 0; i < v; i++)
+		csr -> in_start[i + 1] += csr -> in_start[i],
+		csr -> out_start[i + 1] += csr -> out_start[i];
+
+	for (i = 0; i < e; i++) {
+		if (edges[i].flag)
+			continue;
+
+		j = edges[i].vertices[NN_FORWARD], k = edges[i].vertices[NN_BACKWARD];
+
+		csr -> in_source[csr -> in_start[j]] = k,
+		csr -> in_edge[csr -> in_start[j]++] = i;
+
+		csr -> out_target[csr -> out_start[k]] = j,
+		csr -> out_edge[csr -> out_start[k]++] = i;
+	}
+
+	for (i = v; i > 0; i--)
+		csr -> in_start[i] = csr -> in_start[i - 1],
+		csr -> out_start[i] = csr -> out_start[i - 1];
+
+	csr -> in_start[0] = 0, csr -> out_start[0] = 0;
+
+	NNtopo_order(network, order);
+
+	for (i = 0; i < s; i++)
+		csr -> order[i] = order[i] - vertices;
+
+	free(order);
+
+	NNcsr_load(csr, network);
+
+	return csr;
+
+fail:
+	if (order != NULL)
+		free(order);
+
+	if (csr != NULL)
+		free(csr);
+
+	return NULL;
+}
+
+
+/*
+	free the adjacency built by NNget_csr
+
+	csr -- the adjacency to free
+*/
+
+void NNfree_csr(struct NNcsr * csr) {
+
+	free(csr);
+	return;
+}
+
+
+/*
+	copy the weights, the edge and vertex statistics and the vertex state of the network into the adjacency
+
+	csr -- the adjacency of the network
+	network -- the neural network csr was built from
+*/
+
+void NNcsr_load(struct NNcsr * csr, const struct NNetwork * network) {
+
+	unsigned int n = csr -> edges, v = csr -> vertices, i;
+	const struct NNvertex * vertices = (const void *)network -> contents;
+	const struct NNedge * edges = (const void *)(vertices + v), * edge;
+
+	for (i = 0; i < v; i++)
+		csr -> value[i] = vertices[i].value,
+		csr -> output[i] = vertices[i].output,
+		csr -> d_output[i] = vertices[i].d_output,
+		csr -> derivative[i] = vertices[i].derivative,
+		csr -> vertex_nuance[i] = vertices[i].nuance,
+		csr -> vertex_count[i] = vertices[i].count;
+
+	for (i = 0; i < n; i++) {
+		edge = edges + csr -> in_edge[i];
+		csr -> in_weight[i] = edge -> weight,
+		csr -> nuance[i] = edge -> nuance,
+		csr -> count[i] = edge -> count;
+	}
+
+	for (i = 0; i < n; i++)
+		csr -> out_weight[i] = edges[csr -> out_edge[i]].weight;
+
+	return;
+}
+
+
+/*
+	copy the vertex state and the edge and vertex statistics gathered in the adjacency back into the network
+
+	csr -- the adjacency of the network
+	network -- the neural network csr was built from
+*/
+
+void NNcsr_store(const struct NNcsr * csr, struct NNetwork * network) {
+
+	unsigned int n = csr -> edges, v = csr -> vertices, i;
+	struct NNvertex * vertices = (void *)network -> contents;
+	struct NNedge * edges = (void *)(vertices + v), * edge;
+
+	for (i = 0; i < v; i++)
+		vertices[i].value = csr -> value[i],
+		vertices[i].output = csr -> output[i],
+		vertices[i].d_output = csr -> d_output[i],
+		vertices[i].derivative = csr -> derivative[i],
+		vertices[i].nuance = csr -> vertex_nuance[i],
+		vertices[i].count = csr -> vertex_count[i];
+
+	for (i = 0; i < n; i++) {
+		edge = edges + csr -> in_edge[i];
+		edge -> nuance = csr -> nuance[i],
+		edge -> count = csr -> count[i];
+	}
+
+	return;
+}
+
+
+/*
+	predict the outputs of the neural network over its compact adjacency
+
+	csr -- the adjacency of the network, loaded with its current weights (see NNcsr_load)
+	inputs -- the inputs of the network
+	outputs -- where to store the outputs
+
+	return 0 on success
+
+	note: only the hot arrays of the adjacency are touched, the network itself is not needed. value and output of csr are overwritten, so one adjacency serves one thread at a time.
+*/
+
+int NNpredict_csr(struct NNcsr * csr, const double * inputs, double * outputs) {
+
+	unsigned int first = csr -> inputs + 1, s = csr -> steps, i, j, k;
+	double value, * values = csr -> value, * outs = csr -> output;
+
+	const unsigned int * start = csr -> in_start, * source = csr -> in_source;
+	const double * weight = csr -> in_weight;
+
+	for (i = 0; i < csr -> inputs; i++)
+		values[i + 1] = inputs[i],
+		outs[i + 1] = csr -> activate[i + 1](inputs[i]);
+
+	for (i = 0; i < s; i++) {
+		j = csr -> order[i];
+
+		for (k = start[j], value = 0; k < start[j + 1]; k++)
+			value += weight[k] * outs[source[k]];
+
+		values[j] = value,
+		outs[j] = csr -> activate[j](value);
+	}
+
+	for (i = 0; i < csr -> outputs; i++)
+		outputs[i] = values[first + i];
+
+	return 0;
+}
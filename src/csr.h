@@ -0,0 +1,29 @@
+#ifndef __CSR_H
+#define __CSR_H
+
+#include "model.h"
+
+
+struct NNcsr;
+
+struct NNcsr {
+	unsigned int inputs, outputs, vertices, edges, steps;
+	unsigned int * order;
+	unsigned int * in_start, * in_source, * in_edge;
+	unsigned int * out_start, * out_target, * out_edge;
+	double * in_weight, * out_weight, * nuance, * count;
+	double * value, * output, * d_output, * derivative, * vertex_nuance, * vertex_count;
+	NNActiv * activate, * d_activate;
+	char contents[];
+};
+
+struct NNcsr * NNget_csr(const struct NNetwork * network);
+void NNfree_csr(struct NNcsr * csr);
+
+void NNcsr_load(struct NNcsr * csr, const struct NNetwork * network);
+void NNcsr_store(const struct NNcsr * csr, struct NNetwork * network);
+
+int NNpredict_csr(struct NNcsr * csr, const double * inputs, double * outputs);
+
+
+#endif
@@ -0,0 +1,188 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dataset.h"
+#include "binary.h"
+
+
+extern int NNdebug;
+
+
+/*
+	save samples as a dataset file
+
+	file -- the filename of the dataset (pathname)
+	rows -- the samples, double[size][inputs + outputs] or float[size][inputs + outputs] as type
+	size -- the number of samples
+	inputs -- the inputs of every sample
+	outputs -- the expected outputs of every sample, following its inputs
+	type -- NN_DOUBLE or NN_FLOAT, the element type of rows
+
+	return 0 on success, -1 on failure. errno set by fclose > fwrite > fopen, EINVAL for a bad type
+
+	note: the file is a struct NNdata_header followed by the rows as they are in memory, row-major and native (little-endian) byte order, the rows start 64 bytes in so a mapping is aligned for both types
+*/
+
+int NNdataset_save(const char * file, const void * rows, size_t size, unsigned int inputs, unsigned int outputs, int type) {
+
+	FILE * fp = NULL;
+	struct NNdata_header header;
+	size_t width = (size_t)inputs + outputs;
+
+	if ((type != NN_DOUBLE) && (type != NN_FLOAT)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NN_DATA_MAGIC, sizeof(NN_DATA_MAGIC));
+	header.version = NN_DATA_VERSION,
+	header.endian = NN_BIN_ENDIAN,
+	header.inputs = inputs,
+	header.outputs = outputs,
+	header.type = type,
+	header.rows = size;
+
+	if ((fp = fopen(file, "wb")) == NULL)
+		goto fail;
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		goto fail;
+
+	if (fwrite(rows, (type == NN_FLOAT) ? sizeof(float) : sizeof(double), size * width, fp) != size * width)
+		goto fail;
+
+	if (fclose(fp) == EOF) {
+		fp = NULL;
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	if (fp != NULL)
+		fclose(fp);
+
+	return -1;
+}
+
+
+/*
+	map a dataset file read-only
+
+	file -- the filename of the dataset (pathname)
+
+	return the dataset on success, NULL on failure. errno set by mmap > fstat > open, or by malloc, EINVAL if the file is not a valid dataset of this build
+
+	note: the rows are not read, the pages are faulted in as training touches them and shared with the page cache, so every process training on the file shares one copy, and a dataset larger than memory can be trained on. Bind it to the parameters of a training with NNdataset_bind, release it with NNdataset_close after the training.
+*/
+
+struct NNdataset * NNdataset_open(const char * file) {
+
+	int fd = -1;
+	struct stat st;
+	void * map = MAP_FAILED;
+	size_t length = 0, width, element;
+
+	const struct NNdata_header * header;
+	struct NNdataset * dataset = NULL;
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+		goto fail;
+
+	if (fstat(fd, &st) == -1)
+		goto fail;
+
+	if ((size_t)st.st_size < sizeof(struct NNdata_header)) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	length = st.st_size;
+
+	if ((map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		goto fail;
+
+	close(fd), fd = -1;
+
+	header = map;
+	width = (size_t)header -> inputs + header -> outputs;
+	element = (header -> type == NN_FLOAT) ? sizeof(float) : sizeof(double);
+
+	if (memcmp(header -> magic, NN_DATA_MAGIC, sizeof(NN_DATA_MAGIC)) || (header -> version != NN_DATA_VERSION) || (header -> endian != NN_BIN_ENDIAN) ||
+		((header -> type != NN_DOUBLE) && (header -> type != NN_FLOAT)) || (width == 0) ||
+		(header -> rows > (length - sizeof(struct NNdata_header)) / width / element) || (header -> rows * width * element != length - sizeof(struct NNdata_header))) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	if ((dataset = malloc(sizeof(struct NNdataset))) == NULL)
+		goto fail;
+
+	dataset -> size = header -> rows,
+	dataset -> length = length,
+	dataset -> inputs = header -> inputs,
+	dataset -> outputs = header -> outputs,
+	dataset -> type = header -> type,
+	dataset -> rows = (char *)map + sizeof(struct NNdata_header),
+	dataset -> map = map;
+
+	return dataset;
+
+fail:
+	if (map != MAP_FAILED)
+		munmap(map, length);
+
+	if (fd != -1)
+		close(fd);
+
+	return NULL;
+}
+
+
+/*
+	unmap a dataset
+
+	dataset -- the dataset returned by NNdataset_open, no training may still use it
+*/
+
+void NNdataset_close(struct NNdataset * dataset) {
+
+	munmap(dataset -> map, dataset -> length);
+	free(dataset);
+	return;
+}
+
+
+/*
+	use a dataset as the training set or the test set of a training
+
+	dataset -- the dataset, its inputs and outputs must be the ones of the network trained
+	param -- the parameters of the training
+	test -- true to set test_set, test_size and test_type, false for the training set
+
+	note: the rows are used in place, they must not be written, so a callback shuffling the training set needs a set in memory
+*/
+
+void NNdataset_bind(const struct NNdataset * dataset, struct NNparam * param, bool test) {
+
+	if (test) {
+		param -> test_set = dataset -> rows,
+		param -> test_size = dataset -> size,
+		param -> test_type = dataset -> type;
+	} else {
+		param -> train_set = dataset -> rows,
+		param -> train_size = dataset -> size,
+		param -> train_type = dataset -> type;
+	}
+
+	return;
+}
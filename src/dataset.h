@@ -0,0 +1,38 @@
+#ifndef __DATASET_H
+#define __DATASET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "train.h"
+
+#define NN_DATA_MAGIC "NNdata"
+#define NN_DATA_VERSION 1
+
+
+struct NNdata_header;
+struct NNdataset;
+
+struct NNdata_header {
+	char magic[8];
+	uint32_t version, endian, inputs, outputs, type, reserved0;
+	uint64_t rows;
+	uint8_t reserved[24];
+};
+
+struct NNdataset {
+	size_t size, length;
+	unsigned int inputs, outputs;
+	int type;
+	void * rows, * map;
+};
+
+int NNdataset_save(const char * file, const void * rows, size_t size, unsigned int inputs, unsigned int outputs, int type);
+struct NNdataset * NNdataset_open(const char * file);
+void NNdataset_close(struct NNdataset * dataset);
+
+void NNdataset_bind(const struct NNdataset * dataset, struct NNparam * param, bool test);
+
+
+#endif
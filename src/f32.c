@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "f32.h"
+
+
+extern int NNdebug;
+
+
+static void NNf32_block(const struct NNplan_f32 * model, const float * inputs, size_t n, float * outputs, float (* values)[NN_BLOCK]);
+
+
+/*
+	convert the neural network to a single precision inference model
+
+	network -- the neural network to convert, it is only read
+
+	return the model on success, NULL if OOM
+
+	note: the model is a sparse compiled plan (see NNcompile_dense) whose weights and activations are float. It is for inference only and never reflects later changes of the network.
+*/
+
+struct NNplan_f32 * NNto_f32(const struct NNetwork * network) {
+
+	struct NNplan * plan = NULL;
+	struct NNplan_f32 * model = NULL;
+
+	if ((plan = NNcompile_dense(network, NN_NO_DENSE)) == NULL)
+		return NULL;
+
+	unsigned int s = plan -> steps, l = plan -> links, i;
+
+	if ((model = malloc(sizeof(struct NNplan_f32) + s * sizeof(struct NNstep) + l * sizeof(struct NNlink_f32))) == NULL) {
+		NNfree_plan(plan);
+		return NULL;
+	}
+
+	model -> inputs = plan -> inputs,
+	model -> outputs = plan -> outputs,
+	model -> vertices = plan -> vertices,
+	model -> steps = s,
+	model -> links = l;
+
+	model -> step = (void *)model -> contents,
+	model -> link = (void *)(model -> step + s);
+
+	for (i = 0; i < s; i++)
+		model -> step[i] = plan -> step[i];
+
+	for (i = 0; i < l; i++)
+		model -> link[i].vertex = plan -> link[i].vertex,
+		model -> link[i].weight = (float)plan -> link[i].weight;
+
+	NNfree_plan(plan);
+
+	return model;
+}
+
+
+/*
+	free the single precision model
+
+	model -- the model to free
+*/
+
+void NNfree_f32(struct NNplan_f32 * model) {
+
+	free(model);
+	return;
+}
+
+
+/*
+	predict the outputs by provided inputs using a single precision model
+
+	model -- the model converted by NNto_f32
+	inputs -- the inputs for the model
+	outputs -- the address to store an array of outputs
+
+	return 0 on success, -1 on failed (OOM).
+
+	note: as NNpredict_plan, the values are kept on the stack up to NN_STACK vertices and on the heap of the call beyond, the model is only read and may be shared by many threads
+*/
+
+int NNpredict_f32(const struct NNplan_f32 * model, const float * inputs, float * outputs) {
+
+	unsigned int ins = model -> inputs, s = model -> steps, hidden = s - model -> outputs, i, k = 0;
+	float stack[NN_STACK], * values = (model -> vertices <= NN_STACK) ? stack : malloc(model -> vertices * sizeof(float)), value;
+
+	const struct NNstep * step = model -> step;
+	const struct NNlink_f32 * link = model -> link;
+
+	if (values == NULL)
+		return -1;
+
+	values[0] = 1;
+
+	for (i = 0; i < ins; i++)
+		values[i + 1] = inputs[i];
+
+	for (i = 0; i < hidden; i++) {
+
+		for (value = 0; k < step[i].links; k++)
+			value += link[k].weight * values[link[k].vertex];
+
+		values[step[i].vertex] = (float)step[i].activate(value);
+	}
+
+	for (; i < s; i++) {
+
+		for (value = 0; k < step[i].links; k++)
+			value += link[k].weight * values[link[k].vertex];
+
+		outputs[i - hidden] = value;
+	}
+
+	if (values != stack)
+		free(values);
+
+	return 0;
+}
+
+
+/*
+	predict the outputs of many samples at once using a single precision model
+
+	model -- the model converted by NNto_f32
+	inputs -- the inputs of all samples in the form float[n][inputs]
+	n -- the number of samples
+	outputs -- where to store the outputs in the form float[n][outputs]
+
+	return 0 on success, -1 on failed (OOM).
+
+	note: see NNpredict_plan_batch, a block here holds as many floats as the double one holds doubles
+*/
+
+int NNpredict_f32_batch(const struct NNplan_f32 * model, const float * inputs, size_t n, float * outputs) {
+
+	unsigned int ins = model -> inputs, outs = model -> outputs;
+	size_t i;
+
+	float (* values)[NN_BLOCK] = NULL;
+	if ((values = aligned_alloc(64, model -> vertices * sizeof(float [NN_BLOCK]))) == NULL)
+		return -1;
+
+	for (i = 0; i < n; i += NN_BLOCK)
+		NNf32_block(model, inputs + i * ins, (n - i < NN_BLOCK) ? (n - i) : NN_BLOCK, outputs + i * outs, values);
+
+	free(values);
+
+	return 0;
+}
+
+
+/*
+	compare the single precision model with the double precision network on a data set
+
+	network -- the neural network the model is converted from
+	model -- the single precision model
+	set -- the 2-d matrix of samples in the form double[size][inputs + outputs], as the train_set of NNparam
+	size -- the entries of the set
+	report -- where to store the accuracy
+
+	return 0 on success, -1 on failed (OOM).
+*/
+
+int NNaccuracy_f32(const struct NNetwork * network, const struct NNplan_f32 * model, double ** set, size_t size, struct NNaccuracy * report) {
+
+	unsigned int inputs = model -> inputs, outputs = model -> outputs, j;
+	size_t i;
+	double (* samples)[inputs + outputs] = (double (*)[inputs + outputs])set, outs[outputs], error, deviation, sum = 0, square = 0, max = 0, cost = 0, cost_f32 = 0;
+	float ins[inputs], outs_f32[outputs];
+
+	struct NNplan * plan = NULL;
+	if ((plan = NNcompile(network)) == NULL)
+		return -1;
+
+	report -> worst = 0;
+
+	for (i = 0; i < size; i++) {
+
+		for (j = 0; j < inputs; j++)
+			ins[j] = (float)samples[i][j];
+
+		if ((NNpredict_plan(plan, samples[i], outs) == -1) || (NNpredict_f32(model, ins, outs_f32) == -1)) {
+			NNfree_plan(plan);
+			return -1;
+		}
+
+		for (j = 0, deviation = 0; j < outputs; j++) {
+			error = fabs(outs_f32[j] - outs[j]);
+			sum += error, square += error * error;
+
+			if (error > deviation)
+				deviation = error;
+
+			error = outs[j] - samples[i][inputs + j], cost += error * error;
+			error = outs_f32[j] - samples[i][inputs + j], cost_f32 += error * error;
+		}
+
+		if (deviation > max)
+			max = deviation, report -> worst = i;
+	}
+
+	NNfree_plan(plan);
+
+	size_t entries = (size > 0 && outputs > 0) ? size * outputs : 1;
+
+	report -> size = size,
+	report -> max_error = max,
+	report -> mean_error = sum / entries,
+	report -> rms_error = sqrt(square / entries),
+	report -> cost = cost / entries,
+	report -> cost_f32 = cost_f32 / entries;
+
+	return 0;
+}
+
+
+/*
+	dump the accuracy report
+
+	stream -- the writable stream dump to
+	report -- the report filled by NNaccuracy_f32
+*/
+
+void NNdump_accuracy(FILE * stream, const struct NNaccuracy * report) {
+
+	if (fprintf(stream, "samples: %zu\n", report -> size) < 0)
+		return;
+
+	if (fprintf(stream, "deviation max: %g (sample %zu), mean: %g, rms: %g\n", report -> max_error, report -> worst, report -> mean_error, report -> rms_error) < 0)
+		return;
+
+	fprintf(stream, "mean squared error double: %g, float: %g\n", report -> cost, report -> cost_f32);
+
+	return;
+}
+
+
+/*
+	evaluate one block of samples through the single precision model, see NNplan_block
+*/
+
+NN_SIMD void NNf32_block(const struct NNplan_f32 * model, const float * inputs, size_t n, float * outputs, float (* values)[NN_BLOCK]) {
+
+	unsigned int ins = model -> inputs, outs = model -> outputs, s = model -> steps, hidden = s - outs, i, k = 0;
+	size_t j;
+	float acc[NN_BLOCK], weight;
+
+	const struct NNstep * step = model -> step;
+	const struct NNlink_f32 * link = model -> link;
+	const float * x;
+
+	for (j = 0; j < NN_BLOCK; j++)
+		values[0][j] = 1;
+
+	for (i = 0; i < ins; i++)
+		for (j = 0; j < NN_BLOCK; j++)
+			values[i + 1][j] = (j < n) ? inputs[j * ins + i] : 0;
+
+	for (i = 0; i < s; i++) {
+
+		for (j = 0; j < NN_BLOCK; j++)
+			acc[j] = 0;
+
+		for (; k < step[i].links; k++) {
+			weight = link[k].weight, x = values[link[k].vertex];
+			for (j = 0; j < NN_BLOCK; j++)
+				acc[j] += weight * x[j];
+		}
+
+		if (i < hidden) {
+			activ_nf_table[step[i].activ_index](NN_BLOCK, acc, values[step[i].vertex]);
+		} else {
+			for (j = 0; j < n; j++)
+				outputs[j * outs + i - hidden] = acc[j];
+		}
+	}
+
+	return;
+}
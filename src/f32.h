@@ -0,0 +1,49 @@
+#ifndef __F32_H
+#define __F32_H
+
+#include <stddef.h>
+
+#include "plan.h"
+
+
+struct NNplan_f32;
+struct NNlink_f32;
+struct NNaccuracy;
+
+struct NNplan_f32 {
+	unsigned int inputs, outputs, vertices, steps, links;
+	struct NNstep * step;
+	struct NNlink_f32 * link;
+	char contents[];
+};
+
+struct NNlink_f32 {
+	unsigned int vertex;
+	float weight;
+};
+
+/*
+	the accuracy of a single precision model against the double one
+
+	size -- the number of samples compared
+	worst -- the sample with the greatest deviation
+	max_error, mean_error, rms_error -- the absolute deviation of single precision outputs from double precision outputs
+	cost, cost_f32 -- the mean squared error against the expected outputs, for the double and the single precision model
+*/
+
+struct NNaccuracy {
+	size_t size, worst;
+	double max_error, mean_error, rms_error, cost, cost_f32;
+};
+
+struct NNplan_f32 * NNto_f32(const struct NNetwork * network);
+void NNfree_f32(struct NNplan_f32 * model);
+
+int NNpredict_f32(const struct NNplan_f32 * model, const float * inputs, float * outputs);
+int NNpredict_f32_batch(const struct NNplan_f32 * model, const float * inputs, size_t n, float * outputs);
+
+int NNaccuracy_f32(const struct NNetwork * network, const struct NNplan_f32 * model, double ** set, size_t size, struct NNaccuracy * report);
+void NNdump_accuracy(FILE * stream, const struct NNaccuracy * report);
+
+
+#endif
@@ -2,30 +2,12 @@
 #include <stdio.h>
 
 #include "iter.h"
+#include "schedule.h"
 
 
 extern int NNdebug;
 
 
-struct NNiter {
-	size_t size, brk;
-	bool direction;
-	struct NNedge * edge;
-	struct NNvertex * vertices[];
-};
-
-static struct NNiter * NNiter_push(struct NNiter * iter, struct NNvertex * vertex);
-static struct NNvertex * NNiter_pop(struct NNiter * iter);
-
-static inline size_t parent(size_t index);
-static inline size_t right(size_t index);
-static inline size_t left(size_t index);
-static inline void swap(struct NNvertex ** vertices, size_t i, size_t j);
-static inline int NNlayer_compare(struct NNvertex ** vertices, unsigned int i, unsigned int j, bool direction);
-
-static inline size_t next_pow(size_t v);
-
-
 /* 
 	get an iterator for the neural network
 
@@ -33,311 +15,166 @@ static inline size_t next_pow(size_t v);
 	direction -- forward (false/0) or backward (true/1) iterator, a forward iterator starts from inputs to outputs, and viseversa.
 
 	return the pointer that points to the iterator, NULL if failed due to OOM.
+
+	note: the iterator walks the cached schedule of the network (see NNget_schedule), which is built here if the network has none. See NNiter_init for an iterator that never allocates.
 */
 
 struct NNiter * NNget_iter(struct NNetwork * network, bool direction) {
 
-	size_t size = 2 * network -> vertices, brk;
-	struct NNiter * iter = malloc(sizeof(struct NNiter) + size * sizeof(struct NNvertex *));
+	struct NNschedule * schedule;
+	struct NNiter * iter;
 
-	if (iter == NULL)
+	if ((schedule = NNget_schedule(network)) == NULL)
 		return NULL;
 
-	iter -> size = size;
-	iter -> direction = direction;
-	iter -> edge = NULL;
-
-	size_t amount = direction ? (network -> outputs) : (network -> inputs);
-	iter -> brk = (brk = next_pow(amount + 1));
-
-	struct NNvertex * vertex = (void *)network -> contents;
-	vertex += direction * (network -> inputs);
-
-	size_t i;
-	for (i = brk >> 1; i < brk; i++)
-		iter -> vertices[i] = NULL;
+	if ((iter = malloc(sizeof(struct NNiter))) == NULL)
+		return NULL;
 
-	for (i = 1; i <= amount; i++)
-		iter -> vertices[i] = vertex + i;
+	iter -> schedule = schedule;
+	NNiter_reset(iter, direction);
 
 	return iter;
 }
 
 
 /*
-	iterate the neural network referred to by the iter
+	find the size of workspace NNiter_init needs for the neural network
 
-	addr -- the address of iterator uses to iterate the network
-	buffer -- the buffer to store next object in the iter
+	network -- the specific network to iterate
 
-	return an interger representing the object returned in buf, 0(NNITER_IS_VERTEX) means buf is a vertex, 1(NNITER_IS_EDGE) means buf is an edge, -1(NNITER_IS_EMPTY) means the iter is empty (no more objects in the queue left) and NULL is returned in buf, -2(NNITER_IS_ERROR) means error occured (due to OOM while push new vertex)
+	return the size in bytes, sizeof(struct NNiter) if the network has a cached schedule, otherwise enough to build a private one as well
 
-	note: forward iter would not reach the bias((NNvertex *)content[0]) and edges adjacent to it, backward iter would not reach vertex of layer_index 0. One may use a forward iter to traverse all vertices(note the bias is constant), and use the backward iter to traverse all edges. An edge with flag = 1 will not enter the iter (means further network is detached).
+	note: the size is found without traversing the network. It only holds while the cached schedule of the network is kept (see NNinvalidate_schedule), so query again after the topology changes.
 */
 
-int NNiterate(struct NNiter ** addr, void * buffer) {
-
-	struct NNiter * iter = *addr;
-	void ** buf = buffer;
+size_t NNiter_workspace_size(const struct NNetwork * network) {
 
-re:
-	if (((*buf = iter -> edge) == NULL) && (iter -> vertices[1] == NULL))
-		return NNITER_IS_EMPTY;
+	if (network -> schedule != NULL)
+		return sizeof(struct NNiter);
 
-	bool direction = iter -> direction;
-//if (NNdebug) {printf("buf: %p\n", *buf);}
-	if (*buf != NULL) {
-
-		if ((*(struct NNedge **)buf) -> flag) {
-			iter -> edge = (iter -> edge) -> next[direction];
-			goto re;
-		}
-//if (NNdebug) {printf("buf: %p\n", *buf);}
-		iter = NNiter_push(iter, (*(struct NNedge **)buf) -> vertices[direction]);
-//if (NNdebug) printf("n\n");
-		if (iter == NULL)
-			return NNITER_IS_ERROR;
-
-		*addr = iter;
-
-		iter -> edge = (iter -> edge) -> next[direction];
-		return NNITER_IS_EDGE;
-	}
-//if (NNdebug) printf("n\n");
-	*buf = NNiter_pop(iter);//if (NNdebug) printf("n\n");
-	iter -> edge = (*(struct NNvertex **)buf) -> edges[direction];
-	return NNITER_IS_VERTEX;
+	return sizeof(struct NNiter) + NNschedule_bound(network);
 }
 
 
 /*
-	free the iterator for neural network
-	
-	iter -- the pointer to the NNiter structure to free
-*/
+	get an iterator for the neural network inside a workspace given by the caller
 
-void NNfree_iter(struct NNiter * iter) {
-
-	free(iter);
-	return;
-}
-
-
-/*
-	push a vertex to the iterator
+	network -- the specific network to iterate
+	direction -- forward (false/0) or backward (true/1) iterator, as NNget_iter
+	workspace -- the memory to hold the iterator (and a schedule if the network has none), suitably aligned for struct NNiter
+	size -- the size of workspace, at least NNiter_workspace_size(network)
 
-	iter -- pointer to the iterator push to
-	vertex -- pointer to the vertex to push
+	return the pointer to the iterator (the start of workspace), NULL if workspace is too small
 
-	return pointer to the new iterator on success, NULL on fail (majorly due to OOM)
+	note: nothing is allocated here or while iterating. If the network has a cached schedule it is walked, otherwise a private schedule is built in workspace and not cached, so the network is only read and threads may iterate it at the same time, each with its own workspace. The iterator can be rewound with NNiter_reset as often as wanted and must not be passed to NNfree_iter, the workspace is released by its owner.
 */
 
-struct NNiter * NNiter_push(struct NNiter * iter, struct NNvertex * vertex) { //if (NNdebug) printf("push\n");
-
-	if (vertex -> layer_index == 0)
-		return iter;
-
-	struct NNvertex ** vertices = iter -> vertices;
-	bool direction = iter -> direction;
+struct NNiter * NNiter_init(struct NNetwork * network, bool direction, void * workspace, size_t size) {
 
-	size_t brk = iter -> brk, index;
-	for (index = brk >> 1; (index < brk) && (vertices[index] != NULL); index++);
+	struct NNiter * iter = workspace;
+	const struct NNschedule * schedule = network -> schedule;
 
-	if (index == brk) {
-		iter -> brk = (brk <<= 1);
-		if (iter -> size < brk)
-			if ((iter = realloc(iter, sizeof(struct NNiter) + (iter -> size = brk + 1) * sizeof(struct NNvertex *))) == NULL)
-				return NULL;
-
-		for (index = brk >> 1; index < brk; index++)
-			vertices[index] = NULL;
+	if (size < sizeof(struct NNiter))
+		return NULL;
 
-		index = brk >> 1;
-	}
+	if (schedule == NULL)
+		if ((schedule = NNplace_schedule(network, iter + 1, size - sizeof(struct NNiter))) == NULL)
+			return NULL;
 
-	vertices[index] = vertex;
+	iter -> schedule = schedule;
+	NNiter_reset(iter, direction);
 
-	while (index > 1) {
-		if (NNlayer_compare(vertices, index, parent(index), direction) >= 0)
-			break;
-		swap(vertices, index, parent(index));
-		index = parent(index);
-	}
-//if (NNdebug) NNdump_iter(stdout, iter);
 	return iter;
 }
 
 
 /*
-	pop the vertex with most layer_index according to direction of the iterator, least if forward(0), greatest if backward(1)
-
-	iter -- the iterator to pop
-
-	return the pointer to vertex just popped
-*/
+	rewind the iterator to the start of the traversal
 
-struct NNvertex * NNiter_pop(struct NNiter * iter) { //if (NNdebug) printf("pop\n");
-
-	struct NNvertex ** vertices = iter -> vertices;
-	struct NNvertex * vertex = vertices[1];
-
-	size_t index, brk = iter -> brk;
-
-	bool direction = iter -> direction;
-
-	while (vertex == vertices[1]) {//if (NNdebug) printf("po\n");
-
-		index = 1;
-		while (right(index) < brk) {//if (NNdebug) printf("%zu, %zu\n", index, brk);
-			if (NNlayer_compare(vertices, left(index), right(index), direction) < 0) {//if (NNdebug) printf("pon\n");
-				if (vertices[left(index)] == NULL)
-					break;
-				vertices[index] = vertices[left(index)];
-				index = left(index);
-			} else {//if (NNdebug) printf("pom\n");
-				if (vertices[right(index)] == NULL)
-					break;
-				vertices[index] = vertices[right(index)];
-				index = right(index);
-			}
-		}
-
-		vertices[index] = NULL;
-
-		for (index = brk >> 1; (index < brk) && (vertices[index] == NULL); index++);
-
-		if (index == brk) 
-			iter -> brk = (brk >>= 1);
-	}
-
-	return vertex;
-}
-
-
-/*
-	dump the iterator structure
-
-	stream -- the writable stream sump to
-	iter -- the iteratore to dump
+	iter -- the iterator to rewind, from NNget_iter or NNiter_init
+	direction -- the direction of the traversal from now on, the schedule holds both
 */
 
-void NNdump_iter(FILE * stream, struct NNiter * iter) {
-
-	struct NNvertex ** vertices = iter -> vertices;
-
-	if (fprintf(stream, "\niter at %p -- %p:\n", (void *)iter, (void *)(vertices + iter -> size)) < 0)
-		return;
-
-	if (fprintf(stream, "size: %zu\n", iter -> size) < 0)
-		return;
-
-	size_t brk = iter -> brk, i;
-
-	if (fprintf(stream, "brk: %zu, at: %p\n", brk, (void *)(vertices + brk)) < 0)
-		return;
-
-	if (fprintf(stream, "direction: %d\n", iter -> direction) < 0)
-		return;
-
-	if (fprintf(stream, "edge: %p\n\n", (void *)iter -> edge) < 0)
-		return;
-
-	for (i = 1; i < brk; i++)
-		if (fprintf(stream, "vertex %zu at %p: %p\n", i, (void *)(vertices + i), (void *)vertices[i]) < 0)
-			return;
+void NNiter_reset(struct NNiter * iter, bool direction) {
 
-	fprintf(stream, "\n\n\n");
+	iter -> direction = direction,
+	iter -> next = 0,
+	iter -> edge = 0,
+	iter -> end = 0;
 
 	return;
 }
 
 
 /*
-	compare two vertices in the iterator base on their layer_index
-
-	vertices -- the vertice array the iter allocated
-	i -- the first vertex's index
-	j -- the second vertex's index
-	direction -- the direction of the iterator
-
-	return -1, 0, 1 for i, i == j, j according to the direction
-*/
-
-int NNlayer_compare(struct NNvertex ** vertices, unsigned int i, unsigned int j, bool direction) {
-
-	if (vertices[i] == NULL) {
-		return 1;
-	} else if (vertices[j] == NULL) {
-		return -1;
-	}
-//if (NNdebug) {printf("%p, ", vertices[i]);printf("%p\n", vertices[j]);}
-	if (vertices[i] -> layer_index > vertices[j] -> layer_index) {
-		return 1 - (((int)direction) << 1);
-	} else if (vertices[i] -> layer_index < vertices[j] -> layer_index) {
-		return -1 + (((int)direction) << 1);
-	}
+	iterate the neural network referred to by the iter
 
-	return 0;
-}
+	addr -- the address of iterator uses to iterate the network
+	buffer -- the buffer to store next object in the iter
 
+	return an interger representing the object returned in buf, 0(NNITER_IS_VERTEX) means buf is a vertex, 1(NNITER_IS_EDGE) means buf is an edge, -1(NNITER_IS_EMPTY) means the iter is empty (no more objects in the queue left) and NULL is returned in buf, -2(NNITER_IS_ERROR) is kept for compatibility and no longer returned
 
-/*
-	swap two elements in array vertices
+	note: forward iter would not reach the bias((NNvertex *)content[0]) and edges adjacent to it, backward iter would not reach vertex of layer_index 0. One may use a forward iter to traverse all vertices(note the bias is constant), and use the backward iter to traverse all edges. An edge with flag = 1 will not enter the iter (means further network is detached). Vertices come in the order of the schedule, each vertex once and followed by its edges, vertices fed only by the bias included.
 */
 
-void swap(struct NNvertex ** vertices, size_t i, size_t j) {
+int NNiterate(struct NNiter ** addr, void * buffer) {
 
-	void * tmp = vertices[i];
-	vertices[i] = vertices[j];
-	vertices[j] = tmp;
-	return;
-}
+	struct NNiter * iter = *addr;
+	const struct NNschedule * schedule = iter -> schedule;
+	bool direction = iter -> direction;
+	void ** buf = buffer;
 
+	if (iter -> edge < iter -> end) {
+		*buf = schedule -> edge[direction][iter -> edge++];
+		return NNITER_IS_EDGE;
+	}
 
-/*
-	get parent index of index
-*/
+	if (iter -> next == schedule -> vertices[direction]) {
+		*buf = NULL;
+		return NNITER_IS_EMPTY;
+	}
 
-size_t parent(size_t index) {
+	iter -> edge = schedule -> first[direction][iter -> next],
+	iter -> end = schedule -> first[direction][iter -> next + 1];
 
-	return (index >> 1);
+	*buf = schedule -> vertex[direction][iter -> next++];
+	return NNITER_IS_VERTEX;
 }
 
 
 /*
-	get right child index of index
+	free the iterator for neural network
+	
+	iter -- the pointer to the NNiter structure to free, from NNget_iter only
 */
 
-size_t right(size_t index) {
+void NNfree_iter(struct NNiter * iter) {
 
-	return ((index << 1) | 0x1);
+	free(iter);
+	return;
 }
 
 
 /*
-	get right child index of index
-*/
+	dump the iterator structure
 
-size_t left(size_t index) {
+	stream -- the writable stream sump to
+	iter -- the iteratore to dump
+*/
 
-	return (index << 1);
-}
+void NNdump_iter(FILE * stream, struct NNiter * iter) {
 
+	const struct NNschedule * schedule = iter -> schedule;
+	bool direction = iter -> direction;
 
-/*
-	get next power base 2 of v
-*/
+	if (fprintf(stream, "\niter at %p, schedule at %p:\n", (void *)iter, (void *)schedule) < 0)
+		return;
 
-size_t next_pow(size_t v) {
+	if (fprintf(stream, "direction: %d\n", direction) < 0)
+		return;
 
-	v--;
-	v |= v >> 1;
-	v |= v >> 2;
-	v |= v >> 4;
-	v |= v >> 8;
-	v |= v >> 16;
-	v |= v >> 32;
-	v++;
+	if (fprintf(stream, "vertex: %u of %u, edge: %u -- %u of %u, layers: %u\n\n\n", iter -> next, schedule -> vertices[direction], iter -> edge, iter -> end, schedule -> edges[direction], schedule -> layers[direction]) < 0)
+		return;
 
-	return v;
+	return;
 }
@@ -2,6 +2,7 @@
 #define __ITER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "model.h"
 
@@ -13,11 +14,21 @@
 #define NNITER_IS_EMPTY -1
 #define NNITER_IS_ERROR -2
 
-struct NNiter;
+struct NNschedule;
+
+struct NNiter {
+	bool direction;
+	unsigned int next, edge, end;
+	const struct NNschedule * schedule;
+};
 
 struct NNiter * NNget_iter(struct NNetwork * network, bool direction);
 int NNiterate(struct NNiter ** addr, void * buffer);
 
+size_t NNiter_workspace_size(const struct NNetwork * network);
+struct NNiter * NNiter_init(struct NNetwork * network, bool direction, void * workspace, size_t size);
+void NNiter_reset(struct NNiter * iter, bool direction);
+
 void NNfree_iter(struct NNiter * iter);
 
 void NNdump_iter(FILE * stream, struct NNiter * iter);
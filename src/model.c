@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "model.h"
 #include "iter.h"
+#include "schedule.h"
 
 
 extern int NNdebug;
@@ -16,7 +18,7 @@ extern int NNdebug;
 
 	return the network created, NULL if OOM while request size of network
 
-	note: the network created is a bipartite graph (K_inputs+1,outputs)
+	note: the network created is a bipartite graph (K_inputs+1,outputs), all weights 0
 */
 
 struct NNetwork * NNcreate(unsigned int inputs, unsigned int outputs) {
@@ -30,67 +32,41 @@ struct NNetwork * NNcreate(unsigned int inputs, unsigned int outputs) {
 	network -> inputs = inputs,
 	network -> outputs = outputs,
 	network -> vertices = v,
-	network -> edges = e;
-
-	struct NNvertex * in = (void*)network -> contents;
-	struct NNvertex * out = in + inputs + 1;
-	struct NNedge * edges = (void *)(in + v), *last;
+	network -> edges = e,
+	network -> schedule = NULL;
 
-	in[0].value = 1;
-	in[0].map = NULL;
-
-	for (i = 0; i <= inputs; i++) {
-		in[i].layer_index = 0,
-		in[i].activ_index = _identity,
-		in[i].activate = activ_table[_identity],
-		in[i].d_activate = d_activ_table[_identity];
-		in[i].map = NULL;
-	}
+	struct NNvertex * vertices = (void *)network -> contents;
+	struct NNedge * edges = (void *)(vertices + v);
 
-	for (i = 0; i < outputs; i++) {
-		out[i].layer_index = -1,
-		out[i].activ_index = _identity,
-		out[i].activate = activ_table[_identity],
-		out[i].d_activate = d_activ_table[_identity];
-		out[i].map = NULL;
+	for (i = 0; i < v; i++) {
+		vertices[i].layer_index = (i <= inputs) ? 0 : (unsigned int)-1,
+		vertices[i].activ_index = _identity,
+		vertices[i].value = 0,
+		vertices[i].output = 0,
+		vertices[i].d_output = 0,
+		vertices[i].derivative = 0,
+		vertices[i].nuance = 0,
+		vertices[i].count = 0,
+		vertices[i].edges[NN_FORWARD] = NN_NIL,
+		vertices[i].edges[NN_BACKWARD] = NN_NIL,
+		vertices[i].map = NN_NIL;
 	}
 
-	for (i = 0; i <= inputs; i++) {
-		last = NULL;
-
-		for (j = 0; j < outputs; j++) {
+	vertices[0].value = 1,
+	vertices[0].output = 1;
 
-			k = i + inputs * j;
+	for (j = outputs, k = e; j-- > 0;) {
+		for (i = inputs + 1; i-- > 0;) {
+			k--;
+			edges[k].flag = 0,
 			edges[k].weight = 0,
 			edges[k].value = 0,
-			edges[k].vertices[0] = &out[j],
-			edges[k].vertices[1] = &in[i];
-
-			if (last != NULL) {
-				last -> next[0] = &edges[k];
-			} else {
-				in[i].edges[0] = &edges[k],
-				in[i].edges[1] = NULL;
-			}
-
-			last = &edges[k];
-		}
-	}
-
-	struct NNedge * inverse[inputs + 2];
-
-	for (i = 0; i <= inputs; i++)
-		inverse[i] = in[i].edges[0];
-
-	inverse[inputs + 1] = NULL;
-
-	for (j = 0; j < outputs; j++) {
-		out[j].edges[1] = inverse[0],
-		out[j].edges[0] = NULL;
-
-		for (i = 0; i <= inputs; i++) {
-			inverse[i] -> next[1] = inverse[i + 1];
-			inverse[i] = inverse[i] -> next[0];
+			edges[k].derivative = 0,
+			edges[k].nuance = 0,
+			edges[k].count = 0,
+			edges[k].vertices[NN_FORWARD] = inputs + 1 + j,
+			edges[k].vertices[NN_BACKWARD] = i;
+			NNattach(vertices, edges, k);
 		}
 	}
 
@@ -106,6 +82,7 @@ struct NNetwork * NNcreate(unsigned int inputs, unsigned int outputs) {
 
 void NNfree(struct NNetwork * network) {
 
+	NNinvalidate_schedule(network);
 	free(network);
 	return;
 }
@@ -116,9 +93,9 @@ void NNfree(struct NNetwork * network) {
 
 	file -- the filename(pathname) of the model file
 
-	return the pointer to neural network on success, NULL on failure. errno set in fclose > fscanf >= malloc > fopen
+	return the pointer to neural network on success, NULL on failure. errno set in fclose > fscanf >= calloc > fopen
 
-	note: error from fscanf majorly due to wrongly formatted model file
+	note: error from fscanf majorly due to wrongly formatted model file. The fields the model does not hold are zero. NNload_fast reads the same format with many threads.
 */
 
 struct NNetwork * NNload(char * file) {
@@ -133,24 +110,24 @@ struct NNetwork * NNload(char * file) {
 	if (fscanf(fp, "%u %u %u %u", &inputs, &outputs, &v, &e) != 4)
 		goto fail;
 
-	if ((network = malloc(sizeof(struct NNetwork) + v * sizeof(struct NNvertex) + e * sizeof(struct NNedge))) == NULL)
+	if ((network = calloc(1, sizeof(struct NNetwork) + v * sizeof(struct NNvertex) + e * sizeof(struct NNedge))) == NULL)
 		goto fail;
 
 	network -> inputs = inputs,
 	network -> outputs = outputs,
 	network -> vertices = v;
 	network -> edges = e;
+	network -> schedule = NULL;
 
 	struct NNvertex * vertices = (void *)network -> contents;
 	struct NNedge * edges = (void *)(vertices + v);
 
 	vertices[0].layer_index = 0,
 	vertices[0].activ_index = _identity,
-	vertices[0].activate = activ_table[_identity],
-	vertices[0].d_activate = d_activ_table[_identity],
 	vertices[0].value = 1,
-	vertices[0].edges[0] = (vertices[0].edges[1] = NULL);
-	vertices[0].map = NULL;
+	vertices[0].output = 1,
+	vertices[0].edges[0] = (vertices[0].edges[1] = NN_NIL);
+	vertices[0].map = NN_NIL;
 
 	int aid = 0;
 	unsigned int i, j, k = 0, lid = 0;
@@ -160,11 +137,9 @@ struct NNetwork * NNload(char * file) {
 			goto fail;
 
 		vertices[i].layer_index = lid,
-		vertices[i].activ_index = aid,
-		vertices[i].activate = activ_table[aid],
-		vertices[i].d_activate = d_activ_table[aid];
-		vertices[i].edges[0] = (vertices[i].edges[1] = NULL);
-		vertices[i].map = NULL;
+		vertices[i].activ_index = aid;
+		vertices[i].edges[0] = (vertices[i].edges[1] = NN_NIL);
+		vertices[i].map = NN_NIL;
 	}
 
 	double w = 0.0;
@@ -173,17 +148,18 @@ struct NNetwork * NNload(char * file) {
 		if (fscanf(fp, "%u %u %lf", &i, &j, &w) != 3)
 			goto fail;
 
+		if ((i >= v) || (j >= v))
+			goto fail;
+
 		edges[k].flag = 0,
 		edges[k].weight = w,
-		edges[k].vertices[0] = &vertices[i],
-		edges[k].vertices[1] = &vertices[j];
+		edges[k].vertices[0] = i,
+		edges[k].vertices[1] = j;
 
 		if (!j)
 			edges[k].value = w;
 
-		edges[k].next[1] = vertices[i].edges[1];
-		edges[k].next[0] = vertices[j].edges[0];
-		vertices[j].edges[0] = (vertices[i].edges[1] = &edges[k]);
+		NNattach(vertices, edges, k);
 	}
 
 	fclose(fp);
@@ -208,17 +184,23 @@ fail:
 	file -- the filename of model to save (pathname)
 
 	return 0 on success, -1 on failure. errno set by fclose > NNiterate > fprintf > fopen
+
+	note: the edges saved are the ones reached by a backward traversal (see NNget_schedule), the header counts exactly those
 */
 
 int NNsave(struct NNetwork * network, const char * file) {
 
 	FILE * fp = NULL;
-	struct NNiter * iter = NULL;
+	struct NNiter workspace, * iter = NULL;
+	struct NNschedule * schedule = NULL;
+
+	if ((schedule = NNget_schedule(network)) == NULL)
+		return -1;
 
 	if ((fp = fopen(file, "wt")) == NULL)
 		goto fail;
 //printf("s\n");
-	unsigned int v = network -> vertices, e = network -> edges, i, j;
+	unsigned int v = network -> vertices, e = schedule -> edges[NN_BACKWARD], i, j;
 
 	if (fprintf(fp, "%u %u %u %u\n", network -> inputs, network -> outputs, v, e) < 0)
 		goto fail;
@@ -230,24 +212,20 @@ int NNsave(struct NNetwork * network, const char * file) {
 			goto fail;
 //printf("s\n");
 	struct NNedge * edge;
-	if ((iter = NNget_iter(network, NN_BACKWARD)) == NULL)
+	if ((iter = NNiter_init(network, NN_BACKWARD, &workspace, sizeof(workspace))) == NULL)
 		goto fail;
 //printf("s\n");
 	int flag;
 	while ((flag = NNiterate(&iter, &edge)) >= 0) {
 
 		if (flag == NNITER_IS_EDGE) {
-			i = edge -> vertices[0] - vertices,
-			j = edge -> vertices[1] - vertices;//NNdump(stdout, network);
+			i = edge -> vertices[0],
+			j = edge -> vertices[1];//NNdump(stdout, network);
 			if (fprintf(fp, "%u %u %lf\n", i, j, edge -> weight) < 0) 
 				goto fail;
 		}
 	}
 //printf("s\n");
-	if (flag == NNITER_IS_ERROR)
-		goto fail;
-//printf("s\n");
-	NNfree_iter(iter);
 	fclose(fp);
 
 	return 0;
@@ -256,9 +234,6 @@ fail:
 	if (fp != NULL)
 		fclose(fp);
 
-	if (iter != NULL)
-		NNfree_iter(iter);
-
 	return -1;
 }
 
@@ -269,50 +244,59 @@ fail:
 	network -- the neural network given for making copy of
 
 	return the copied network on success, NULL on failed
+
+	note: the blob is position independent, the copy is a single memcpy. The schedule of network is not shared with the copy.
 */
 
 struct NNetwork * NNcopy(struct NNetwork * network) {
 
-	unsigned int v = network -> vertices, e = network -> edges, i;
+	size_t size = NNsize(network);
 
 	struct NNetwork * copy = NULL;
-	if ((copy = malloc(sizeof(struct NNetwork) + v * sizeof(struct NNvertex) + e * sizeof(struct NNedge))) == NULL)
+	if ((copy = malloc(size)) == NULL)
 		return NULL;
 
-	copy -> inputs = network -> inputs,
-	copy -> outputs = network -> outputs,
-	copy -> vertices = v,
-	copy -> edges = e;
+	memcpy(copy, network, size);
+	copy -> schedule = NULL;
 
-	struct NNvertex * vertices = (void *)network -> contents, * new_vertices = (void *)copy -> contents;
-	struct NNedge * edges = (void *)(vertices + v), * new_edges = (void *)(new_vertices + v);
+	return copy;
+}
 
-	for (i = 0; i < v; i++) {
-		new_vertices[i].value = vertices[i].value;
-		new_vertices[i].layer_index = vertices[i].layer_index,
-		new_vertices[i].activ_index = vertices[i].activ_index,
-		new_vertices[i].activate = vertices[i].activate,
-		new_vertices[i].d_activate = vertices[i].d_activate,
-		new_vertices[i].map = NULL;
-		vertices[i].map = & new_vertices[i];
-	}
 
-	for (i = 0; i < e; i++) {
-		new_edges[i].flag = 0,
-		new_edges[i].weight = edges[i].weight,
-		new_edges[i].nuance = edges[i].nuance,
-		new_edges[i].vertices[NN_FORWARD] = edges[i].vertices[NN_FORWARD] -> map,
-		new_edges[i].vertices[NN_BACKWARD] = edges[i].vertices[NN_BACKWARD] -> map;
-		new_edges[i].next[NN_FORWARD] = new_edges[i].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-		new_edges[i].next[NN_BACKWARD] = new_edges[i].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-		new_edges[i].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[i],
-		new_edges[i].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[i];
-	}
+/*
+	find the size of the neural network blob
 
-	for (i = 0; i < v; i++)
-		vertices[i].map = NULL;
+	network -- the neural network to measure
 
-	return copy;
+	return the size in bytes of the header, the vertices and the edges
+*/
+
+size_t NNsize(const struct NNetwork * network) {
+
+	return sizeof(struct NNetwork) + network -> vertices * sizeof(struct NNvertex) + network -> edges * sizeof(struct NNedge);
+}
+
+
+/*
+	link an edge into the edge lists of both its vertices
+
+	vertices -- the vertex array of the network
+	edges -- the edge array of the network
+	edge -- the index of the edge, its vertices set
+
+	note: the edge is put in front of the outgoing list of its source and the incoming list of its target
+*/
+
+void NNattach(struct NNvertex * vertices, struct NNedge * edges, unsigned int edge) {
+
+	struct NNvertex * target = vertices + edges[edge].vertices[NN_FORWARD], * source = vertices + edges[edge].vertices[NN_BACKWARD];
+
+	edges[edge].next[NN_FORWARD] = source -> edges[NN_FORWARD],
+	edges[edge].next[NN_BACKWARD] = target -> edges[NN_BACKWARD];
+	source -> edges[NN_FORWARD] = edge,
+	target -> edges[NN_BACKWARD] = edge;
+
+	return;
 }
 
 
@@ -338,7 +322,7 @@ void NNdump(FILE * stream, struct NNetwork * network) {
 	for (i = 0; i < v; i++) {
 		if (fprintf(stream, "\nvertex %u at %p -- %p:\n", i, (void *)(vertices + i), (void *)(vertices + i + 1)) < 0)
 			return;
-		if (fprintf(stream, "layer_index: %u\nactiv_index: %d\nvalue: %lf\nderivative: %lf\nnuance: %lf\ncount: %lf\nedge forward: %p\nedge backward: %p\nmap: %p\n", vertices[i].layer_index, vertices[i].activ_index, vertices[i].value, vertices[i].derivative, vertices[i].nuance, vertices[i].count, (void *)vertices[i].edges[NN_FORWARD], (void *)vertices[i].edges[NN_BACKWARD], (void *)vertices[i].map) < 0)
+		if (fprintf(stream, "layer_index: %u\nactiv_index: %d\nvalue: %lf\noutput: %lf\nd_output: %lf\nderivative: %lf\nnuance: %lf\ncount: %lf\nedge forward: %d\nedge backward: %d\nmap: %d\n", vertices[i].layer_index, vertices[i].activ_index, vertices[i].value, vertices[i].output, vertices[i].d_output, vertices[i].derivative, vertices[i].nuance, vertices[i].count, (int)vertices[i].edges[NN_FORWARD], (int)vertices[i].edges[NN_BACKWARD], (int)vertices[i].map) < 0)
 			return;
 	}
 
@@ -350,7 +334,7 @@ void NNdump(FILE * stream, struct NNetwork * network) {
 	for (i = 0; i < e; i++) {
 		if (fprintf(stream, "\nedge %u at %p -- %p:\n", i, (void *)(edges + i), (void *)(edges + i + 1)) < 0)
 			return;
-		if (fprintf(stream, "flag: %d\nweight: %lf\nvalue: %lf\nderivative: %lf\nnuance: %lf\ncount: %lf\nvertex forward: %p\nvertex backward: %p\nedge forward: %p\nedge backward: %p\n", edges[i].flag, edges[i].weight, edges[i].value, edges[i].derivative, edges[i].nuance, edges[i].count, (void *)edges[i].vertices[NN_FORWARD], (void *)edges[i].vertices[NN_BACKWARD], (void *)edges[i].next[NN_FORWARD], (void *)edges[i].next[NN_BACKWARD]) < 0)
+		if (fprintf(stream, "flag: %d\nweight: %lf\nvalue: %lf\nderivative: %lf\nnuance: %lf\ncount: %lf\nvertex forward: %u\nvertex backward: %u\nedge forward: %d\nedge backward: %d\n", edges[i].flag, edges[i].weight, edges[i].value, edges[i].derivative, edges[i].nuance, edges[i].count, edges[i].vertices[NN_FORWARD], edges[i].vertices[NN_BACKWARD], (int)edges[i].next[NN_FORWARD], (int)edges[i].next[NN_BACKWARD]) < 0)
 			return;
 	}
 
@@ -3,30 +3,38 @@
 
 #include "activation.h"
 
+#define NN_NIL ((unsigned int)-1)
+#define NN_EDGE(edges, index) (((index) == NN_NIL) ? NULL : (edges) + (index))
+
 
 struct NNetwork;
 struct NNvertex;
 struct NNedge;
+struct NNschedule;
 
 struct NNetwork {
 	unsigned int inputs, outputs, vertices, edges;
+	struct NNschedule * schedule;
 	char contents[];
 };
 
+/*
+	the network is one blob: the header, then vertices, then edges. Links are 32-bit indices, vertex links into the vertex array and edge links into the edge array, NN_NIL for none, so the blob holds no address and stays valid when copied, shared or mapped. Activations are found by activ_index in activ_table and d_activ_table. schedule is a cache of the process owning the network and is not part of the blob.
+*/
+
 struct NNvertex {
 	unsigned int layer_index;
 	int activ_index;
-	NNActiv activate, d_activate;
-	double value, derivative, nuance, count;
-	struct NNedge * edges[2];
-	struct NNvertex * map;
+	double value, output, d_output, derivative, nuance, count;
+	unsigned int edges[2];
+	unsigned int map;
 };
 
 struct NNedge {
 	int flag;
 	double weight, value, derivative, nuance, count;
-	struct NNvertex * vertices[2];
-	struct NNedge * next[2];
+	unsigned int vertices[2];
+	unsigned int next[2];
 };
 
 struct NNetwork * NNcreate(unsigned int inputs, unsigned int outputs);
@@ -37,6 +45,9 @@ int NNsave(struct NNetwork * network, const char * file);
 
 struct NNetwork * NNcopy(struct NNetwork * network);
 
+size_t NNsize(const struct NNetwork * network);
+void NNattach(struct NNvertex * vertices, struct NNedge * edges, unsigned int edge);
+
 void NNdump(FILE * stream, struct NNetwork * network);
 
 
@@ -0,0 +1,497 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "parse.h"
+#include "iter.h"
+#include "pool.h"
+
+#define NN_TOKEN 128
+#define NN_DIGITS 19
+#define NN_EXACT 22
+
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+#define NN_FAST_DOUBLE 1
+#else
+#define NN_FAST_DOUBLE 0
+#endif
+
+
+extern int NNdebug;
+
+
+struct NNparse {
+	unsigned int v, e;
+	struct NNedge * edges;
+	struct NNpool * pool;
+	const char * end;
+	const char ** bound;
+	size_t * tokens;
+	int * status;
+};
+
+static void NNparse_edges(void * arg, unsigned int id, unsigned int threads);
+static const char * NNnext(const char * p, const char * end, const char ** q);
+static const char * NNterminate(const char * p, const char * q, const char * end, char * buffer);
+static int NNparse_unsigned(const char * p, const char * q, const char * end, unsigned int * x);
+static int NNparse_int(const char * p, const char * q, const char * end, int * x);
+static int NNparse_double(const char * p, const char * q, const char * end, double * x);
+static bool NNspace(char c);
+
+
+/*
+	load the neural network model from a file with many threads, as NNload
+
+	file -- the filename(pathname) of the model file
+	threads -- the number of threads parsing the edges, 0 is treated as 1
+
+	return the pointer to neural network on success, NULL on failure. errno set by munmap > calloc > mmap > fstat > open, or by NNpool_create, EINVAL if the file is not a valid model
+
+	note: the file is mapped whole. The header and the vertices are read in order, the edge section is cut at whitespace into one chunk per thread, the threads count the numbers of the chunks before theirs, then parse their numbers straight into their edges. The adjacency lists are linked afterwards in file order, so the network is identical to the one NNload returns (unused fields are zero in both). Numbers must be separated by whitespace, as NNsave writes them; they are read as fscanf reads them in the "C" locale, decimals with at most 19 significant digits and small exponents by hand, the others by strtod.
+*/
+
+struct NNetwork * NNload_fast(const char * file, unsigned int threads) {
+
+	int fd = -1;
+	struct stat st;
+	void * map = MAP_FAILED;
+	size_t size = 0;
+	bool complete;
+
+	struct NNetwork * network = NULL;
+	struct NNparse parse = {.pool = NULL, .bound = NULL};
+	const char * p, * q, * end;
+
+	unsigned int inputs, outputs, v, e, i, k;
+	unsigned int * header[4] = {&inputs, &outputs, &v, &e};
+
+	if (threads == 0)
+		threads = 1;
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+		goto fail;
+
+	if (fstat(fd, &st) == -1)
+		goto fail;
+
+	if ((size = st.st_size) == 0) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	if ((map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		goto fail;
+
+	close(fd), fd = -1;
+
+	p = map, end = p + size;
+
+	for (i = 0; i < 4; i++, p = q)
+		if (((p = NNnext(p, end, &q)) == NULL) || (NNparse_unsigned(p, q, end, header[i]) == -1))
+			goto invalid;
+
+	if (v < (size_t)inputs + outputs + 1)
+		goto invalid;
+
+	if ((network = calloc(1, sizeof(struct NNetwork) + v * sizeof(struct NNvertex) + e * sizeof(struct NNedge))) == NULL)
+		goto fail;
+
+	network -> inputs = inputs,
+	network -> outputs = outputs,
+	network -> vertices = v,
+	network -> edges = e,
+	network -> schedule = NULL;
+
+	struct NNvertex * vertices = (void *)network -> contents;
+	struct NNedge * edges = (void *)(vertices + v);
+
+	vertices[0].layer_index = 0,
+	vertices[0].activ_index = _identity,
+	vertices[0].value = 1,
+	vertices[0].output = 1,
+	vertices[0].edges[NN_FORWARD] = (vertices[0].edges[NN_BACKWARD] = NN_NIL),
+	vertices[0].map = NN_NIL;
+
+	for (i = 1; i < v; i++) {
+
+		if (((p = NNnext(p, end, &q)) == NULL) || (NNparse_unsigned(p, q, end, &vertices[i].layer_index) == -1))
+			goto invalid;
+
+		if (((p = NNnext(q, end, &q)) == NULL) || (NNparse_int(p, q, end, &vertices[i].activ_index) == -1))
+			goto invalid;
+
+		vertices[i].edges[NN_FORWARD] = (vertices[i].edges[NN_BACKWARD] = NN_NIL),
+		vertices[i].map = NN_NIL;
+		p = q;
+	}
+
+	if (e > 0) {
+
+		if ((parse.bound = malloc((threads + 1) * sizeof(const char *) + threads * (sizeof(size_t) + sizeof(int)))) == NULL)
+			goto fail;
+
+		parse.tokens = (void *)(parse.bound + threads + 1),
+		parse.status = (void *)(parse.tokens + threads);
+
+		parse.v = v,
+		parse.e = e,
+		parse.edges = edges,
+		parse.end = end;
+
+		parse.bound[0] = p, parse.bound[threads] = end;
+
+		for (i = 1; i < threads; i++) {
+			q = p + (size_t)(end - p) * i / threads;
+			if (q < parse.bound[i - 1])
+				q = parse.bound[i - 1];
+
+			while ((q < end) && !NNspace(* q))
+				q++;
+
+			parse.bound[i] = q;
+		}
+
+		if (threads > 1) {
+			if ((parse.pool = NNpool_create(threads)) == NULL)
+				goto fail;
+
+			NNpool_run(parse.pool, & NNparse_edges, &parse);
+			NNpool_free(parse.pool), parse.pool = NULL;
+		}
+		else
+			NNparse_edges(&parse, 0, 1);
+
+		for (i = 0, complete = false; i < threads; i++) {
+			if (parse.status[i] == -1)
+				goto invalid;
+
+			complete |= parse.status[i];
+		}
+
+		if (!complete)
+			goto invalid;
+
+		free(parse.bound), parse.bound = NULL;
+	}
+
+	for (k = 0; k < e; k++) {
+		if (!edges[k].vertices[NN_BACKWARD])
+			edges[k].value = edges[k].weight;
+
+		NNattach(vertices, edges, k);
+	}
+
+	if (munmap(map, size) == -1) {
+		map = MAP_FAILED;
+		goto fail;
+	}
+
+	return network;
+
+invalid:
+	errno = EINVAL;
+
+fail:
+	if (parse.pool != NULL)
+		NNpool_free(parse.pool);
+
+	if (parse.bound != NULL)
+		free(parse.bound);
+
+	if (network != NULL)
+		free(network);
+
+	if (map != MAP_FAILED)
+		munmap(map, size);
+
+	if (fd != -1)
+		close(fd);
+
+	return NULL;
+}
+
+
+/*
+	parse the edge section of a model, the task of NNload_fast
+
+	arg -- the struct NNparse of the load
+	id -- the chunk of this thread, bound[id] up to bound[id + 1]
+	threads -- the number of chunks
+
+	note: every chunk but the last counts its numbers into tokens[id], then each chunk sums the counts before it for the index of its first number and parses its numbers into edges[index / 3], target, source and weight in turn. status[id] is -1 if a number is malformed or a vertex out of range, 1 if the chunk read the last edge, else 0.
+*/
+
+void NNparse_edges(void * arg, unsigned int id, unsigned int threads) {
+
+	struct NNparse * parse = arg;
+	const char * p, * q, * end = parse -> bound[id + 1];
+	size_t n = 0, k;
+	unsigned int f, x, i;
+	bool space = true, blank;
+
+	if (id + 1 < threads)
+		for (p = parse -> bound[id]; p < end; p++, space = blank) {
+			blank = NNspace(* p);
+			n += space && !blank;
+		}
+
+	parse -> tokens[id] = n;
+
+	if (parse -> pool != NULL)
+		NNpool_barrier(parse -> pool);
+
+	for (i = 0, n = 0; i < id; i++)
+		n += parse -> tokens[i];
+
+	k = n / 3,
+	f = n % 3;
+
+	for (p = parse -> bound[id]; (k < parse -> e) && ((p = NNnext(p, end, &q)) != NULL); p = q) {
+
+		if (f == 2) {
+			if (NNparse_double(p, q, parse -> end, &parse -> edges[k].weight) == -1)
+				goto fail;
+
+			f = 0, k++;
+			continue;
+		}
+
+		if ((NNparse_unsigned(p, q, parse -> end, &x) == -1) || (x >= parse -> v))
+			goto fail;
+
+		parse -> edges[k].vertices[f ? NN_BACKWARD : NN_FORWARD] = x;
+		f++;
+	}
+
+	parse -> status[id] = (k == parse -> e);
+	return;
+
+fail:
+	parse -> status[id] = -1;
+	return;
+}
+
+
+/*
+	find the next number of a model
+
+	p -- where to start looking
+	end -- the end of the model
+	q -- where to store the end of the number
+
+	return the first character of the number, NULL if only whitespace is left
+*/
+
+const char * NNnext(const char * p, const char * end, const char ** q) {
+
+	while ((p < end) && NNspace(* p))
+		p++;
+
+	if (p == end)
+		return NULL;
+
+	for (* q = p; (* q < end) && !NNspace(** q); (* q)++);
+
+	return p;
+}
+
+
+/*
+	make a number of a model readable by the strto* functions
+
+	p -- the first character of the number
+	q -- the end of the number
+	end -- the end of the model
+	buffer -- the space for a copy, char[NN_TOKEN]
+
+	return p if the number is followed by whitespace in the model, else the copy in buffer, NULL if the number is too long to copy
+*/
+
+const char * NNterminate(const char * p, const char * q, const char * end, char * buffer) {
+
+	if (q < end)
+		return p;
+
+	if ((size_t)(q - p) >= NN_TOKEN)
+		return NULL;
+
+	memcpy(buffer, p, q - p);
+	buffer[q - p] = '\0';
+
+	return buffer;
+}
+
+
+/*
+	read a number as fscanf %u
+
+	p -- the first character of the number
+	q -- the end of the number
+	end -- the end of the model
+	x -- where to store the number
+
+	return 0 on success, -1 if the whole number is not an integer
+*/
+
+int NNparse_unsigned(const char * p, const char * q, const char * end, unsigned int * x) {
+
+	const char * s = p, * t;
+	char buffer[NN_TOKEN], * r;
+	unsigned int m = 0;
+	bool negative = false;
+
+	if ((* s == '-') || (* s == '+'))
+		negative = (* s++ == '-');
+
+	if ((s < q) && (q - s <= 9)) {
+		for (; (s < q) && (* s >= '0') && (* s <= '9'); s++)
+			m = m * 10 + (unsigned int)(* s - '0');
+
+		if (s == q) {
+			* x = negative ? 0u - m : m;
+			return 0;
+		}
+	}
+
+	if ((t = NNterminate(p, q, end, buffer)) == NULL)
+		return -1;
+
+	* x = (unsigned int)strtoul(t, &r, 10);
+
+	return (r - t == q - p) ? 0 : -1;
+}
+
+
+/*
+	read a number as fscanf %d
+
+	p -- the first character of the number
+	q -- the end of the number
+	end -- the end of the model
+	x -- where to store the number
+
+	return 0 on success, -1 if the whole number is not an integer
+*/
+
+int NNparse_int(const char * p, const char * q, const char * end, int * x) {
+
+	const char * s = p, * t;
+	char buffer[NN_TOKEN], * r;
+	int m = 0;
+	bool negative = false;
+
+	if ((* s == '-') || (* s == '+'))
+		negative = (* s++ == '-');
+
+	if ((s < q) && (q - s <= 9)) {
+		for (; (s < q) && (* s >= '0') && (* s <= '9'); s++)
+			m = m * 10 + (* s - '0');
+
+		if (s == q) {
+			* x = negative ? -m : m;
+			return 0;
+		}
+	}
+
+	if ((t = NNterminate(p, q, end, buffer)) == NULL)
+		return -1;
+
+	* x = (int)strtol(t, &r, 10);
+
+	return (r - t == q - p) ? 0 : -1;
+}
+
+
+/*
+	read a number as fscanf %lf
+
+	p -- the first character of the number
+	q -- the end of the number
+	end -- the end of the model
+	x -- where to store the number
+
+	return 0 on success, -1 if the whole number is not a floating-point number
+
+	note: a plain decimal of at most 19 significant digits whose value is an integer up to 2^53 times or divided by a power of ten up to 10^22 is exact in one rounding, as strtod rounds it. Anything else (more digits, a large exponent, hexadecimal, inf, nan) is left to strtod.
+*/
+
+int NNparse_double(const char * p, const char * q, const char * end, double * x) {
+
+	static const double power[NN_EXACT + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	const char * s = p, * t;
+	char buffer[NN_TOKEN], * r;
+	uint64_t m = 0;
+	int digits = 0, exponent = 0, scale = 0;
+	bool negative = false, mantissa = false, sign = false;
+	double y;
+
+	if ((* s == '-') || (* s == '+'))
+		negative = (* s++ == '-');
+
+	for (; (s < q) && (* s >= '0') && (* s <= '9'); s++, mantissa = true)
+		if ((digits += (m || (* s != '0'))) <= NN_DIGITS)
+			m = m * 10 + (uint64_t)(* s - '0');
+
+	if ((s < q) && (* s == '.'))
+		for (s++; (s < q) && (* s >= '0') && (* s <= '9'); s++, mantissa = true, scale--)
+			if ((digits += (m || (* s != '0'))) <= NN_DIGITS)
+				m = m * 10 + (uint64_t)(* s - '0');
+
+	if (mantissa && (s < q) && ((* s == 'e') || (* s == 'E'))) {
+		if ((++s < q) && ((* s == '-') || (* s == '+')))
+			sign = (* s++ == '-');
+
+		for (t = s; (s < q) && (* s >= '0') && (* s <= '9') && (exponent < 10000); s++)
+			exponent = exponent * 10 + (* s - '0');
+
+		if (s == t)
+			mantissa = false;
+
+		scale += sign ? -exponent : exponent;
+	}
+
+	if (NN_FAST_DOUBLE && mantissa && (s == q) && (digits <= NN_DIGITS)) {
+		if (m == 0) {
+			* x = negative ? -0.0 : 0.0;
+			return 0;
+		}
+
+		if ((m <= (UINT64_C(1) << 53)) && (scale >= -NN_EXACT) && (scale <= NN_EXACT)) {
+			y = (double)m;
+			y = (scale < 0) ? y / power[-scale] : y * power[scale];
+			* x = negative ? -y : y;
+			return 0;
+		}
+	}
+
+	if ((t = NNterminate(p, q, end, buffer)) == NULL)
+		return -1;
+
+	* x = strtod(t, &r);
+
+	return (r - t == q - p) ? 0 : -1;
+}
+
+
+/*
+	check whether a character is whitespace for fscanf in the "C" locale
+*/
+
+bool NNspace(char c) {
+
+	static const bool space[UCHAR_MAX + 1] = {[' '] = true, ['\t'] = true, ['\n'] = true, ['\v'] = true, ['\f'] = true, ['\r'] = true};
+
+	return space[(unsigned char)c];
+}
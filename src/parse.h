@@ -0,0 +1,10 @@
+#ifndef __PARSE_H
+#define __PARSE_H
+
+#include "model.h"
+
+
+struct NNetwork * NNload_fast(const char * file, unsigned int threads);
+
+
+#endif
@@ -0,0 +1,661 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "plan.h"
+#include "iter.h"
+
+#define NN_DENSE_MIN 64
+#define NN_TILE 64
+#define NN_ROWS 4
+#define NN_LANE 8
+
+struct NNwave {
+	const struct NNplan * plan;
+	struct NNpool * pool;
+	double * values, * outputs;
+};
+
+typedef double NNlane __attribute__((vector_size(NN_LANE * sizeof(double))));
+
+
+extern int NNdebug;
+
+
+static void NNplan_block(const struct NNplan * plan, const double * inputs, size_t n, double * outputs, double (* values)[NN_BLOCK]);
+static void NNplan_steps(const struct NNplan * plan, double * values, double * outputs, unsigned int begin, unsigned int end, unsigned int b0, unsigned int b1);
+static void NNplan_wave(void * arg, unsigned int id, unsigned int threads);
+static size_t NNplan_work(const struct NNplan * plan, unsigned int l, unsigned int b0, unsigned int b1);
+static size_t NNplan_widest(const struct NNplan * plan);
+static void NNplan_gemv(const struct NNblock * block, const struct NNstep * step, double * values, bool clear, unsigned int begin, unsigned int end);
+static void NNplan_gemm(const struct NNblock * block, const struct NNstep * step, double (* values)[NN_BLOCK], bool clear);
+
+static int NNstep_compare(const void * element1, const void * element2);
+
+
+/*
+	compile the neural network into an execution plan
+
+	network -- the neural network to compile, it is only read
+
+	return the plan on success, NULL if OOM
+
+	note: the plan is a snapshot of the network, later changes of weights or topology are not reflected. Vertices other than the inputs are stored in topological order (layer_index, then position) and the incoming edges of each vertex are packed right behind the ones of the previous vertex, so the outputs always form the last steps of the plan. Layers connected densely enough (NN_DENSE_RATIO) are turned into dense blocks, see NNcompile_dense.
+*/
+
+struct NNplan * NNcompile(const struct NNetwork * network) {
+
+	return NNcompile_dense(network, NN_DENSE_RATIO);
+}
+
+
+/*
+	compile the neural network into an execution plan with dense blocks
+
+	network -- the neural network to compile, it is only read
+	ratio -- the least fraction of all possible edges between two layers for them to become a dense block, greater than 1 (NN_NO_DENSE) to keep the whole plan sparse
+
+	return the plan on success, NULL if OOM
+
+	note: vertices of the same layer_index form a layer, the bias and the inputs form layer 0. For every layer and every lower layer, the edges between them are counted, and if they fill at least ratio of the complete bipartite graph (and the graph is not tiny, NN_DENSE_MIN) they are moved into a dense block: a column-major matrix with one row per vertex of the upper layer and one column per vertex of the lower layer. All the other edges stay sparse links, so do the edges from a vertex of the same or a higher layer.
+*/
+
+struct NNplan * NNcompile_dense(const struct NNetwork * network, double ratio) {
+
+	unsigned int inputs = network -> inputs, v = network -> vertices, s = v - inputs - 1, groups, links = 0, blocks = 0, cols = 0, i, j, g, h, pass;
+	size_t cells = 0;
+	bool dense;
+
+	const struct NNvertex * vertices = (const void *)network -> contents, ** order = NULL;
+	const struct NNedge * edges = (const void *)(vertices + v), * edge;
+	unsigned int * group = NULL, * place, * start, * size, * count, * slot;
+
+	struct NNplan * plan = NULL;
+	struct NNstep * step = NULL;
+	struct NNlink * link = NULL;
+	struct NNblock * block = NULL;
+	double * weight = NULL;
+	unsigned int * source = NULL;
+
+	if ((order = malloc((s + 1) * sizeof(struct NNvertex *))) == NULL)
+		goto fail;
+
+	if ((group = malloc((2 * (size_t)v + 4 * ((size_t)s + 2)) * sizeof(unsigned int))) == NULL)
+		goto fail;
+
+	place = group + v, start = place + v, size = start + s + 2, count = size + s + 2, slot = count + s + 2;
+
+	NNtopo_order(network, order);
+
+	for (i = 0; i <= inputs; i++)
+		group[i] = 0, place[i] = i;
+
+	start[0] = 0, size[0] = inputs + 1;
+
+	for (i = 0, groups = 1; i < s; i++) {
+		if ((i == 0) || (order[i] -> layer_index != order[i - 1] -> layer_index))
+			start[groups] = i, size[groups] = 0, groups++;
+
+		j = order[i] - vertices;
+		group[j] = groups - 1, place[j] = size[groups - 1]++;
+	}
+
+	start[groups] = s;
+
+	for (pass = 0; pass < 2; pass++) {
+
+		links = 0, blocks = 0, cols = 0, cells = 0;
+
+		for (h = 0; h < groups; h++)
+			count[h] = 0, slot[h] = (unsigned int)-1;
+
+		for (g = 1; g < groups; g++) {
+
+			for (h = 0; h < g; h++)
+				count[h] = 0, slot[h] = (unsigned int)-1;
+
+			for (i = start[g]; i < start[g + 1]; i++)
+				for (edge = NN_EDGE(edges, order[i] -> edges[NN_BACKWARD]); edge != NULL; edge = NN_EDGE(edges, edge -> next[NN_BACKWARD]))
+					if (!edge -> flag && ((h = group[edge -> vertices[NN_BACKWARD]]) < g))
+						count[h]++;
+
+			for (h = 0, dense = false; h < g; h++) {
+				if ((count[h] == 0) || ((size_t)size[g] * size[h] < NN_DENSE_MIN) || (count[h] < ratio * size[g] * size[h]))
+					continue;
+
+				if (pass) {
+					block[blocks].first = start[g],
+					block[blocks].rows = size[g],
+					block[blocks].cols = size[h],
+					block[blocks].source = source + cols,
+					block[blocks].weight = weight + cells;
+
+					for (j = 0; j < size[h]; j++)
+						source[cols + j] = h ? (unsigned int)(order[start[h] + j] - vertices) : j;
+
+					for (j = 0; j < size[g] * size[h]; j++)
+						weight[cells + j] = 0;
+				}
+
+				slot[h] = blocks++, cols += size[h], cells += (size_t)size[g] * size[h];
+				dense = true;
+			}
+
+			for (i = start[g]; i < start[g + 1]; i++) {
+
+				for (edge = NN_EDGE(edges, order[i] -> edges[NN_BACKWARD]); edge != NULL; edge = NN_EDGE(edges, edge -> next[NN_BACKWARD])) {
+					if (edge -> flag)
+						continue;
+
+					j = edge -> vertices[NN_BACKWARD], h = group[j];
+
+					if ((h < g) && (slot[h] != (unsigned int)-1)) {
+						if (pass)
+							block[slot[h]].weight[(size_t)place[j] * block[slot[h]].rows + (i - start[g])] += edge -> weight;
+						continue;
+					}
+
+					if (pass)
+						link[links].vertex = j,
+						link[links].weight = edge -> weight;
+
+					links++;
+				}
+
+				if (pass)
+					step[i].vertex = order[i] - vertices,
+					step[i].links = links,
+					step[i].activ_index = order[i] -> activ_index,
+					step[i].dense = dense,
+					step[i].activate = activ_table[order[i] -> activ_index];
+			}
+		}
+
+		if (pass)
+			break;
+
+		if ((plan = malloc(sizeof(struct NNplan) + s * sizeof(struct NNstep) + links * sizeof(struct NNlink) + blocks * sizeof(struct NNblock) + cells * sizeof(double) + (cols + groups) * sizeof(unsigned int))) == NULL)
+			goto fail;
+
+		step = (void *)plan -> contents,
+		link = (void *)(step + s),
+		block = (void *)(link + links),
+		weight = (void *)(block + blocks),
+		source = (void *)(weight + cells);
+	}
+
+	plan -> inputs = inputs,
+	plan -> outputs = network -> outputs,
+	plan -> vertices = v,
+	plan -> steps = s,
+	plan -> links = links,
+	plan -> blocks = blocks,
+	plan -> layers = groups - 1;
+
+	plan -> layer = source + cols;
+
+	for (g = 1; g <= groups; g++)
+		plan -> layer[g - 1] = start[g];
+
+	plan -> step = step,
+	plan -> link = link,
+	plan -> block = block;
+
+	free(group);
+	free(order);
+
+	return plan;
+
+fail:
+	if (group != NULL)
+		free(group);
+
+	if (order != NULL)
+		free(order);
+
+	return NULL;
+}
+
+
+/*
+	free the execution plan
+
+	plan -- the plan to free
+*/
+
+void NNfree_plan(struct NNplan * plan) {
+
+	free(plan);
+	return;
+}
+
+
+/*
+	predict the outputs by provided inputs using a compiled plan
+
+	plan -- the plan compiled from the neural network
+	inputs -- the inputs for the network
+	outputs -- the address to store an array of outputs
+
+	return 0 on success, -1 on failed (OOM).
+
+	note: the plan is only read, the activated value of each vertex is kept on the stack up to NN_STACK vertices and on the heap of the call beyond. Hence one plan may serve many threads at the same time.
+*/
+
+int NNpredict_plan(const struct NNplan * plan, const double * inputs, double * outputs) {
+
+	unsigned int ins = plan -> inputs, blocks = plan -> blocks, i, l, b = 0, c;
+	double stack[NN_STACK], * values = (plan -> vertices <= NN_STACK) ? stack : malloc(plan -> vertices * sizeof(double));
+
+	const unsigned int * layer = plan -> layer;
+	const struct NNblock * block = plan -> block;
+
+	if (values == NULL)
+		return -1;
+
+	values[0] = 1;
+
+	for (i = 0; i < ins; i++)
+		values[i + 1] = inputs[i];
+
+	for (l = 0; l < plan -> layers; l++) {
+		for (c = b; (b < blocks) && (block[b].first == layer[l]); b++);
+
+		NNplan_steps(plan, values, outputs, layer[l], layer[l + 1], c, b);
+	}
+
+	if (values != stack)
+		free(values);
+
+	return 0;
+}
+
+
+/*
+	predict the outputs by provided inputs, running the vertices of each layer across a pool of threads
+
+	plan -- the plan compiled from the neural network
+	pool -- the threads to run on, see NNpool_create
+	inputs -- the inputs for the network
+	outputs -- the address to store an array of outputs
+
+	return 0 on success, -1 on failed (OOM).
+
+	note: the values are kept as in NNpredict_plan, the vertices of one layer only depend on lower layers, so every layer is cut into one range of rows per thread and the threads meet at a barrier before the next layer. Layers with less than NN_WAVE_MIN multiply-adds are left to a single thread, and if no layer reaches it the whole prediction runs as NNpredict_plan without waking the pool. The outputs are identical to NNpredict_plan.
+*/
+
+int NNpredict_plan_wave(const struct NNplan * plan, struct NNpool * pool, const double * inputs, double * outputs) {
+
+	unsigned int ins = plan -> inputs, i;
+	double stack[NN_STACK], * values;
+
+	if ((pool == NULL) || (NNpool_threads(pool) == 1) || (NNplan_widest(plan) < NN_WAVE_MIN))
+		return NNpredict_plan(plan, inputs, outputs);
+
+	if ((values = (plan -> vertices <= NN_STACK) ? stack : malloc(plan -> vertices * sizeof(double))) == NULL)
+		return -1;
+
+	struct NNwave wave = {plan, pool, values, outputs};
+
+	values[0] = 1;
+
+	for (i = 0; i < ins; i++)
+		values[i + 1] = inputs[i];
+
+	NNpool_run(pool, & NNplan_wave, &wave);
+
+	if (values != stack)
+		free(values);
+
+	return 0;
+}
+
+
+/*
+	predict the outputs of many samples at once using a compiled plan
+
+	plan -- the plan compiled from the neural network
+	inputs -- the inputs of all samples in the form double[n][inputs]
+	n -- the number of samples
+	outputs -- where to store the outputs in the form double[n][outputs]
+
+	return 0 on success, -1 on failed (OOM).
+
+	note: samples are evaluated NN_BLOCK at a time, the activated values of a block are kept per vertex in a sample-major layout so that every multiply-add and activation runs over contiguous samples.
+*/
+
+int NNpredict_plan_batch(const struct NNplan * plan, const double * inputs, size_t n, double * outputs) {
+
+	unsigned int ins = plan -> inputs, outs = plan -> outputs;
+	size_t i;
+
+	double (* values)[NN_BLOCK] = NULL;
+	if ((values = aligned_alloc(64, plan -> vertices * sizeof(double [NN_BLOCK]))) == NULL)
+		return -1;
+
+	for (i = 0; i < n; i += NN_BLOCK)
+		NNplan_block(plan, inputs + i * ins, (n - i < NN_BLOCK) ? (n - i) : NN_BLOCK, outputs + i * outs, values);
+
+	free(values);
+
+	return 0;
+}
+
+
+/*
+	evaluate one block of samples through the plan
+
+	plan -- the plan to evaluate
+	inputs -- the inputs of the block in the form double[n][inputs]
+	n -- the number of samples in the block, no more than NN_BLOCK
+	outputs -- where to store the outputs in the form double[n][outputs]
+	values -- the scratch space for activated values, double[vertices][NN_BLOCK]
+
+	note: a short block is padded with zero samples, the kernels always run over full NN_BLOCK lanes
+*/
+
+NN_SIMD void NNplan_block(const struct NNplan * plan, const double * inputs, size_t n, double * outputs, double (* values)[NN_BLOCK]) {
+
+	unsigned int ins = plan -> inputs, outs = plan -> outputs, s = plan -> steps, hidden = s - outs, blocks = plan -> blocks, i, k = 0, b = 0;
+	size_t j;
+	double acc[NN_BLOCK], weight;
+
+	const struct NNstep * step = plan -> step;
+	const struct NNlink * link = plan -> link;
+	const struct NNblock * block = plan -> block;
+	const double * x;
+
+	for (j = 0; j < NN_BLOCK; j++)
+		values[0][j] = 1;
+
+	for (i = 0; i < ins; i++)
+		for (j = 0; j < NN_BLOCK; j++)
+			values[i + 1][j] = (j < n) ? inputs[j * ins + i] : 0;
+
+	for (i = 0; i < s; i++) {
+
+		for (; (b < blocks) && (block[b].first == i); b++)
+			NNplan_gemm(block + b, step, values, (b == 0) || (block[b - 1].first != i));
+
+		x = values[step[i].vertex];
+		for (j = 0; j < NN_BLOCK; j++)
+			acc[j] = step[i].dense ? x[j] : 0;
+
+		for (; k < step[i].links; k++) {
+			weight = link[k].weight, x = values[link[k].vertex];
+			for (j = 0; j < NN_BLOCK; j++)
+				acc[j] += weight * x[j];
+		}
+
+		if (i < hidden) {
+			activ_n_table[step[i].activ_index](NN_BLOCK, acc, values[step[i].vertex]);
+		} else {
+			for (j = 0; j < n; j++)
+				outputs[j * outs + i - hidden] = acc[j];
+		}
+	}
+
+	return;
+}
+
+
+/*
+	evaluate a range of steps within one layer for a single sample
+
+	plan -- the plan to evaluate
+	values -- the values of all vertices, the lower layers are complete
+	outputs -- where to store the outputs
+	begin -- the first step to evaluate
+	end -- one past the last step to evaluate, no further than the end of the layer of begin
+	b0 -- the first dense block of the layer
+	b1 -- one past the last dense block of the layer
+*/
+
+void NNplan_steps(const struct NNplan * plan, double * values, double * outputs, unsigned int begin, unsigned int end, unsigned int b0, unsigned int b1) {
+
+	unsigned int hidden = plan -> steps - plan -> outputs, i, k, b;
+	double value;
+
+	const struct NNstep * step = plan -> step;
+	const struct NNlink * link = plan -> link;
+	const struct NNblock * block = plan -> block;
+
+	for (b = b0; b < b1; b++)
+		NNplan_gemv(block + b, step, values, b == b0, begin - block[b].first, end - block[b].first);
+
+	for (i = begin, k = begin ? step[begin - 1].links : 0; i < end; i++) {
+
+		for (value = step[i].dense ? values[step[i].vertex] : 0; k < step[i].links; k++)
+			value += link[k].weight * values[link[k].vertex];
+
+		if (i < hidden) {
+			values[step[i].vertex] = step[i].activate(value);
+		} else {
+			outputs[i - hidden] = value;
+		}
+	}
+
+	return;
+}
+
+
+/*
+	the task of every thread in NNpredict_plan_wave
+
+	arg -- the NNwave of the prediction
+	id -- the index of the thread
+	threads -- the number of threads
+*/
+
+void NNplan_wave(void * arg, unsigned int id, unsigned int threads) {
+
+	struct NNwave * wave = arg;
+	const struct NNplan * plan = wave -> plan;
+	const unsigned int * layer = plan -> layer;
+	const struct NNblock * block = plan -> block;
+
+	unsigned int blocks = plan -> blocks, l, b = 0, c, size;
+
+	for (l = 0; l < plan -> layers; l++) {
+		for (c = b; (b < blocks) && (block[b].first == layer[l]); b++);
+
+		size = layer[l + 1] - layer[l];
+
+		if (NNplan_work(plan, l, c, b) < NN_WAVE_MIN) {
+			if (id == 0)
+				NNplan_steps(plan, wave -> values, wave -> outputs, layer[l], layer[l + 1], c, b);
+		} else {
+			NNplan_steps(plan, wave -> values, wave -> outputs, layer[l] + (unsigned int)((size_t)size * id / threads), layer[l] + (unsigned int)((size_t)size * (id + 1) / threads), c, b);
+		}
+
+		NNpool_barrier(wave -> pool);
+	}
+
+	return;
+}
+
+
+/*
+	count the multiply-adds of one layer of a plan
+
+	plan -- the plan
+	l -- the index of the layer
+	b0 -- the first dense block of the layer
+	b1 -- one past the last dense block of the layer
+*/
+
+size_t NNplan_work(const struct NNplan * plan, unsigned int l, unsigned int b0, unsigned int b1) {
+
+	const unsigned int * layer = plan -> layer;
+	const struct NNstep * step = plan -> step;
+
+	size_t work = step[layer[l + 1] - 1].links - (layer[l] ? step[layer[l] - 1].links : 0);
+
+	for (; b0 < b1; b0++)
+		work += (size_t)plan -> block[b0].rows * plan -> block[b0].cols;
+
+	return work;
+}
+
+
+/*
+	find the number of multiply-adds of the widest layer of a plan
+
+	plan -- the plan
+*/
+
+size_t NNplan_widest(const struct NNplan * plan) {
+
+	unsigned int blocks = plan -> blocks, l, b = 0, c;
+	size_t work, widest = 0;
+
+	for (l = 0; l < plan -> layers; l++) {
+		for (c = b; (b < blocks) && (plan -> block[b].first == plan -> layer[l]); b++);
+
+		if ((work = NNplan_work(plan, l, c, b)) > widest)
+			widest = work;
+	}
+
+	return widest;
+}
+
+
+/*
+	accumulate a dense block into the values of its rows, for a single sample
+
+	block -- the dense block
+	step -- the steps of the plan, row r of the block is the vertex of step[block -> first + r]
+	values -- the values of all vertices, the rows receive their partial sums
+	clear -- whether this is the first block of its layer (the rows start from 0)
+	begin -- the first row to compute
+	end -- one past the last row to compute
+
+	note: the matrix is column-major, every column is added to the rows as one multiply-add over contiguous weights. The rows are walked in tiles of NN_TILE whose partial sums stay on a fixed scratch in registers and L1 while the matrix streams through, so the stack does not grow with the layer. Every row sums its columns in the same order whatever range it is computed in.
+*/
+
+NN_SIMD void NNplan_gemv(const struct NNblock * block, const struct NNstep * step, double * values, bool clear, unsigned int begin, unsigned int end) {
+
+	unsigned int rows = block -> rows, cols = block -> cols, r, r0, n, c;
+	double y[NN_TILE], x;
+
+	const double * weight = block -> weight, * w;
+	step += block -> first + begin;
+
+	for (r0 = 0; r0 < end - begin; r0 += NN_TILE) {
+		n = (end - begin - r0 < NN_TILE) ? end - begin - r0 : NN_TILE;
+
+		for (r = 0; r < n; r++)
+			y[r] = clear ? 0 : values[step[r0 + r].vertex];
+
+		if (n == NN_TILE) {
+			for (c = 0; c < cols; c++) {
+				x = values[block -> source[c]], w = weight + (size_t)c * rows + begin + r0;
+				for (r = 0; r < NN_TILE; r++)
+					y[r] += w[r] * x;
+			}
+		} else {
+			for (c = 0; c < cols; c++) {
+				x = values[block -> source[c]], w = weight + (size_t)c * rows + begin + r0;
+				for (r = 0; r < n; r++)
+					y[r] += w[r] * x;
+			}
+		}
+
+		for (r = 0; r < n; r++)
+			values[step[r0 + r].vertex] = y[r];
+	}
+
+	return;
+}
+
+
+/*
+	accumulate a dense block into the values of its rows, for a block of samples
+
+	block -- the dense block
+	step -- the steps of the plan, row r of the block is the vertex of step[block -> first + r]
+	values -- the values of all vertices in the form double[vertices][NN_BLOCK], 64 byte aligned
+	clear -- whether this is the first block of its layer (the rows start from 0)
+
+	note: the sample rows are cut into lanes of NN_LANE doubles. For every lane, NN_ROWS output rows are accumulated in registers over all the columns, so every weight is loaded once per lane and every sample lane once for NN_ROWS rows.
+*/
+
+NN_SIMD void NNplan_gemm(const struct NNblock * block, const struct NNstep * step, double (* values)[NN_BLOCK], bool clear) {
+
+	unsigned int rows = block -> rows, cols = block -> cols, r, c, k;
+	NNlane a0, a1, a2, a3, x, * y0, * y1, * y2, * y3;
+
+	const double * weight = block -> weight, * w;
+	step += block -> first;
+
+	for (k = 0; k < NN_BLOCK; k += NN_LANE) {
+		for (r = 0; r + NN_ROWS <= rows; r += NN_ROWS) {
+			y0 = (NNlane *)(values[step[r].vertex] + k), y1 = (NNlane *)(values[step[r + 1].vertex] + k);
+			y2 = (NNlane *)(values[step[r + 2].vertex] + k), y3 = (NNlane *)(values[step[r + 3].vertex] + k);
+
+			if (clear)
+				a0 = a1 = a2 = a3 = (NNlane){0};
+			else
+				a0 = * y0, a1 = * y1, a2 = * y2, a3 = * y3;
+
+			for (c = 0, w = weight + r; c < cols; c++, w += rows) {
+				x = * (const NNlane *)(values[block -> source[c]] + k);
+				a0 += w[0] * x, a1 += w[1] * x, a2 += w[2] * x, a3 += w[3] * x;
+			}
+
+			* y0 = a0, * y1 = a1, * y2 = a2, * y3 = a3;
+		}
+
+		for (; r < rows; r++) {
+			y0 = (NNlane *)(values[step[r].vertex] + k);
+			a0 = clear ? (NNlane){0} : * y0;
+
+			for (c = 0, w = weight + r; c < cols; c++, w += rows)
+				a0 += w[0] * * (const NNlane *)(values[block -> source[c]] + k);
+
+			* y0 = a0;
+		}
+	}
+
+	return;
+}
+
+
+/*
+	sort the vertices of the neural network in topological order
+
+	network -- the neural network to sort
+	order -- where to store the sorted vertices, room for (vertices - inputs - 1) entries
+
+	return the number of vertices stored
+
+	note: the bias and the inputs are not stored, the others are sorted by layer_index then position, so the outputs come last and in their own order
+*/
+
+unsigned int NNtopo_order(const struct NNetwork * network, const struct NNvertex ** order) {
+
+	unsigned int inputs = network -> inputs, s = network -> vertices - inputs - 1, i;
+	const struct NNvertex * vertices = (const void *)network -> contents;
+
+	for (i = 0; i < s; i++)
+		order[i] = vertices + inputs + 1 + i;
+
+	qsort(order, s, sizeof(struct NNvertex *), & NNstep_compare);
+
+	return s;
+}
+
+
+/*
+	compare two vertices by their layer_index then their position, for qsort
+*/
+
+int NNstep_compare(const void * element1, const void * element2) {
+
+	const struct NNvertex * a = *(const struct NNvertex * const *)element1, * b = *(const struct NNvertex * const *)element2;
+
+	if (a -> layer_index != b -> layer_index)
+		return (a -> layer_index > b -> layer_index) - (a -> layer_index < b -> layer_index);
+
+	return (a > b) - (a < b);
+}
@@ -0,0 +1,61 @@
+#ifndef __PLAN_H
+#define __PLAN_H
+
+#include <stddef.h>
+
+#include "model.h"
+#include "pool.h"
+
+#define NN_BLOCK 32
+
+#define NN_DENSE_RATIO 0.5
+#define NN_NO_DENSE 2.0
+
+#define NN_WAVE_MIN 4096
+
+#define NN_STACK 512
+
+
+struct NNplan;
+struct NNstep;
+struct NNlink;
+struct NNblock;
+
+struct NNplan {
+	unsigned int inputs, outputs, vertices, steps, links, blocks, layers;
+	unsigned int * layer;
+	struct NNstep * step;
+	struct NNlink * link;
+	struct NNblock * block;
+	char contents[];
+};
+
+struct NNstep {
+	unsigned int vertex, links;
+	int activ_index, dense;
+	NNActiv activate;
+};
+
+struct NNlink {
+	unsigned int vertex;
+	double weight;
+};
+
+struct NNblock {
+	unsigned int first, rows, cols;
+	unsigned int * source;
+	double * weight;
+};
+
+struct NNplan * NNcompile(const struct NNetwork * network);
+struct NNplan * NNcompile_dense(const struct NNetwork * network, double ratio);
+void NNfree_plan(struct NNplan * plan);
+
+unsigned int NNtopo_order(const struct NNetwork * network, const struct NNvertex ** order);
+
+int NNpredict_plan(const struct NNplan * plan, const double * inputs, double * outputs);
+int NNpredict_plan_batch(const struct NNplan * plan, const double * inputs, size_t n, double * outputs);
+int NNpredict_plan_wave(const struct NNplan * plan, struct NNpool * pool, const double * inputs, double * outputs);
+
+
+#endif
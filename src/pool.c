@@ -0,0 +1,273 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+
+extern int NNdebug;
+
+
+struct NNpool {
+	unsigned int threads, pending, started;
+	unsigned long generation;
+	bool quit;
+	NNtask task;
+	void * arg;
+	pthread_mutex_t lock;
+	pthread_cond_t wake, done, passed;
+	atomic_uint arrived, sense, sleepers;
+	pthread_t thread[];
+};
+
+struct NNworker {
+	struct NNpool * pool;
+	unsigned int id;
+};
+
+static void * NNpool_worker(void * arg);
+
+
+/*
+	create a pool of persistent threads
+
+	threads -- the number of threads running each task, including the caller of NNpool_run, 0 is treated as 1
+
+	return the pool on success, NULL on failed (OOM or threads can not be created)
+
+	note: threads - 1 workers are started and sleep until NNpool_run hands them a task, so the cost of creating threads is paid once.
+*/
+
+struct NNpool * NNpool_create(unsigned int threads) {
+
+	unsigned int i;
+	struct NNpool * pool = NULL;
+	struct NNworker * worker;
+
+	if (threads == 0)
+		threads = 1;
+
+	if ((pool = malloc(sizeof(struct NNpool) + threads * sizeof(pthread_t))) == NULL)
+		return NULL;
+
+	pool -> threads = threads,
+	pool -> pending = 0,
+	pool -> started = 0,
+	pool -> generation = 0,
+	pool -> quit = false,
+	pool -> task = NULL,
+	pool -> arg = NULL;
+
+	atomic_init(&pool -> arrived, 0);
+	atomic_init(&pool -> sense, 0);
+	atomic_init(&pool -> sleepers, 0);
+
+	if (pthread_mutex_init(&pool -> lock, NULL))
+		goto fail_lock;
+
+	if (pthread_cond_init(&pool -> wake, NULL))
+		goto fail_wake;
+
+	if (pthread_cond_init(&pool -> done, NULL))
+		goto fail_done;
+
+	if (pthread_cond_init(&pool -> passed, NULL))
+		goto fail_passed;
+
+	for (i = 1; i < threads; i++) {
+		if ((worker = malloc(sizeof(struct NNworker))) == NULL)
+			goto fail;
+
+		worker -> pool = pool, worker -> id = i;
+
+		if (pthread_create(pool -> thread + i, NULL, & NNpool_worker, worker)) {
+			free(worker);
+			goto fail;
+		}
+
+		pool -> started++;
+	}
+
+	return pool;
+
+fail:
+	NNpool_free(pool);
+	return NULL;
+
+fail_passed:
+	pthread_cond_destroy(&pool -> done);
+fail_done:
+	pthread_cond_destroy(&pool -> wake);
+fail_wake:
+	pthread_mutex_destroy(&pool -> lock);
+fail_lock:
+	free(pool);
+	return NULL;
+}
+
+
+/*
+	stop the workers and free the pool
+
+	pool -- the pool to free, it must be idle
+*/
+
+void NNpool_free(struct NNpool * pool) {
+
+	unsigned int i;
+
+	pthread_mutex_lock(&pool -> lock);
+	pool -> quit = true;
+	pthread_cond_broadcast(&pool -> wake);
+	pthread_mutex_unlock(&pool -> lock);
+
+	for (i = 1; i <= pool -> started; i++)
+		pthread_join(pool -> thread[i], NULL);
+
+	pthread_cond_destroy(&pool -> passed);
+	pthread_cond_destroy(&pool -> done);
+	pthread_cond_destroy(&pool -> wake);
+	pthread_mutex_destroy(&pool -> lock);
+
+	free(pool);
+	return;
+}
+
+
+/*
+	get the number of threads running each task of the pool
+
+	pool -- the pool to query
+*/
+
+unsigned int NNpool_threads(const struct NNpool * pool) {
+
+	return pool -> threads;
+}
+
+
+/*
+	run a task on every thread of the pool and wait for all of them
+
+	pool -- the pool to run on, one task at a time
+	task -- the task, called as task(arg, id, threads) once for every id
+	arg -- the argument for the task
+
+	note: the caller runs id 0 itself
+*/
+
+void NNpool_run(struct NNpool * pool, NNtask task, void * arg) {
+
+	unsigned int threads = pool -> threads;
+
+	if (threads > 1) {
+		pthread_mutex_lock(&pool -> lock);
+		pool -> task = task,
+		pool -> arg = arg,
+		pool -> pending = threads - 1,
+		pool -> generation++;
+		pthread_cond_broadcast(&pool -> wake);
+		pthread_mutex_unlock(&pool -> lock);
+	}
+
+	task(arg, 0, threads);
+
+	if (threads > 1) {
+		pthread_mutex_lock(&pool -> lock);
+		while (pool -> pending > 0)
+			pthread_cond_wait(&pool -> done, &pool -> lock);
+		pthread_mutex_unlock(&pool -> lock);
+	}
+
+	return;
+}
+
+
+/*
+	wait until all threads running the current task of the pool reach the barrier
+
+	pool -- the pool running the task
+
+	note: the barrier spins NN_SPIN rounds, the wait between two layers of a prediction is usually much shorter than a sleep, then sleeps until the last thread arrives, so a thread waiting long (or on a host with fewer processors than threads) leaves the processor to the threads still working. The last thread only takes the lock when someone sleeps.
+*/
+
+void NNpool_barrier(struct NNpool * pool) {
+
+	unsigned int sense = atomic_load_explicit(&pool -> sense, memory_order_acquire), spin;
+
+	if (pool -> threads == 1)
+		return;
+
+	if (atomic_fetch_add_explicit(&pool -> arrived, 1, memory_order_acq_rel) == pool -> threads - 1) {
+		atomic_store_explicit(&pool -> arrived, 0, memory_order_relaxed);
+		atomic_store(&pool -> sense, sense + 1);
+
+		if (atomic_load(&pool -> sleepers) > 0) {
+			pthread_mutex_lock(&pool -> lock);
+			pthread_cond_broadcast(&pool -> passed);
+			pthread_mutex_unlock(&pool -> lock);
+		}
+
+		return;
+	}
+
+	for (spin = 0; spin < NN_SPIN; spin++)
+		if (atomic_load_explicit(&pool -> sense, memory_order_acquire) != sense)
+			return;
+
+	atomic_fetch_add(&pool -> sleepers, 1);
+
+	pthread_mutex_lock(&pool -> lock);
+	while (atomic_load(&pool -> sense) == sense)
+		pthread_cond_wait(&pool -> passed, &pool -> lock);
+	pthread_mutex_unlock(&pool -> lock);
+
+	atomic_fetch_sub(&pool -> sleepers, 1);
+
+	return;
+}
+
+
+/*
+	the loop of a worker thread
+
+	arg -- the NNworker of the thread, freed on exit
+*/
+
+void * NNpool_worker(void * arg) {
+
+	struct NNworker * worker = arg;
+	struct NNpool * pool = worker -> pool;
+	unsigned int id = worker -> id;
+	unsigned long generation = 0;
+	NNtask task;
+
+	free(worker);
+
+	while (1) {
+		pthread_mutex_lock(&pool -> lock);
+
+		while ((pool -> generation == generation) && !pool -> quit)
+			pthread_cond_wait(&pool -> wake, &pool -> lock);
+
+		if (pool -> quit) {
+			pthread_mutex_unlock(&pool -> lock);
+			break;
+		}
+
+		generation = pool -> generation, task = pool -> task, arg = pool -> arg;
+		pthread_mutex_unlock(&pool -> lock);
+
+		task(arg, id, pool -> threads);
+
+		pthread_mutex_lock(&pool -> lock);
+		if (--pool -> pending == 0)
+			pthread_cond_signal(&pool -> done);
+		pthread_mutex_unlock(&pool -> lock);
+	}
+
+	return NULL;
+}
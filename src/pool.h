@@ -0,0 +1,29 @@
+#ifndef __POOL_H
+#define __POOL_H
+
+#define NN_SPIN 4096
+
+
+struct NNpool;
+
+
+/*
+	the task type run by every thread of a pool
+
+	arg -- the argument given to NNpool_run
+	id -- the index of the running thread, 0 is the caller of NNpool_run
+	threads -- the number of threads running the task
+*/
+
+typedef void (* NNtask)(void * arg, unsigned int id, unsigned int threads);
+
+
+struct NNpool * NNpool_create(unsigned int threads);
+void NNpool_free(struct NNpool * pool);
+
+unsigned int NNpool_threads(const struct NNpool * pool);
+void NNpool_run(struct NNpool * pool, NNtask task, void * arg);
+void NNpool_barrier(struct NNpool * pool);
+
+
+#endif
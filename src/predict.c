@@ -1,8 +1,19 @@
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "predict.h"
+#include "plan.h"
 #include "iter.h"
+#include "schedule.h"
+
+
+struct NNctx {
+	const struct NNetwork * network;
+	unsigned int steps;
+	double * values;
+	const struct NNvertex * order[];
+};
 
 
 /*
@@ -17,15 +28,15 @@
 
 int NNpredict(struct NNetwork * network, const double * inputs, double * outputs) {
 
-	struct NNiter * iter = NULL;
-	if ((iter = NNget_iter(network, NN_FORWARD)) == NULL)
+	struct NNiter workspace, * iter = NULL;
+	if ((NNget_schedule(network) == NULL) || ((iter = NNiter_init(network, NN_FORWARD, &workspace, sizeof(workspace))) == NULL))
 		return -1;
 
 	unsigned int i = 0, outs = network -> outputs;
 	int flag;
 	double value;
-	struct NNvertex * vertex, * vertices = (struct NNvertex *)(void *)(network -> contents) + network -> inputs + 1;
-	struct NNedge * edge;
+	struct NNvertex * vertex, * vertices = (void *)network -> contents;
+	struct NNedge * edges = (void *)(vertices + network -> vertices), * edge;
 	void * buf;
 
 	while ((flag = NNiterate(&iter, &buf)) >= 0) {
@@ -36,33 +47,136 @@ int NNpredict(struct NNetwork * network, const double * inputs, double * outputs
 				vertex = buf;
 				if (vertex -> layer_index == 0) {
 					vertex -> value = inputs[i++];
+					vertex -> output = activ_table[vertex -> activ_index](vertex -> value);
 					break;
 				}
 
-				edge = vertex -> edges[NN_BACKWARD];
+				edge = edges + vertex -> edges[NN_BACKWARD];
 				do {
 					value += edge -> value;
-				} while ((edge = edge -> next[NN_BACKWARD]) != NULL);
+				} while ((edge = NN_EDGE(edges, edge -> next[NN_BACKWARD])) != NULL);
 
 				vertex -> value = value;
+				vertex -> output = activ_table[vertex -> activ_index](value);
 				break;
 
 			case NNITER_IS_EDGE :
 				edge = buf;
-				vertex = edge -> vertices[NN_BACKWARD];
-				edge -> value = (edge -> weight) * vertex -> activate(vertex -> value);
+				edge -> value = (edge -> weight) * vertices[edge -> vertices[NN_BACKWARD]].output;
 				break;
 		}
 	}
 
 	for (i = 0; i < outs; i++)
-		outputs[i] = vertices[i].value;
+		outputs[i] = vertices[network -> inputs + 1 + i].value;
+
+	return 0;
+}
+
+
+/*
+	predict the outputs of many samples using the given neural network
+
+	network -- the neural network to use for predicting the outputs
+	inputs -- the inputs of all samples in the form double[n][inputs]
+	n -- the number of samples
+	outputs -- where to store the outputs in the form double[n][outputs]
+
+	return 0 on success, -1 on failed.
+
+	note: the network is compiled for every call, compile it once with NNcompile and use NNpredict_plan_batch when the same network predicts many batches
+*/
+
+int NNpredict_batch(struct NNetwork * network, const double * inputs, size_t n, double * outputs) {
 
-	if (flag == NNITER_IS_ERROR) {
-		NNfree_iter(iter);
+	struct NNplan * plan = NULL;
+	if ((plan = NNcompile(network)) == NULL)
 		return -1;
+
+	int flag = NNpredict_plan_batch(plan, inputs, n, outputs);
+
+	NNfree_plan(plan);
+	return flag;
+}
+
+
+/*
+	get an inference context for the neural network
+
+	network -- the neural network to predict with, it is never written through the context
+
+	return the context on success, NULL if OOM
+
+	note: the context holds all the scratch state of a prediction, so threads may share one network as long as each of them uses its own context. The context refers to the network, which must stay alive and unchanged while the context is in use.
+*/
+
+struct NNctx * NNget_ctx(const struct NNetwork * network) {
+
+	unsigned int v = network -> vertices, s = v - network -> inputs - 1;
+
+	struct NNctx * ctx = malloc(sizeof(struct NNctx) + s * sizeof(struct NNvertex *) + v * sizeof(double));
+	if (ctx == NULL)
+		return NULL;
+
+	ctx -> network = network,
+	ctx -> steps = NNtopo_order(network, ctx -> order),
+	ctx -> values = (void *)(ctx -> order + s);
+
+	return ctx;
+}
+
+
+/*
+	predict the outputs by provided inputs within an inference context
+
+	ctx -- the context got from NNget_ctx
+	inputs -- the inputs for the neural network of the context
+	outputs -- the address to store an array of outputs
+
+	return 0 on success, -1 on failed.
+*/
+
+int NNpredict_ctx(struct NNctx * ctx, const double * inputs, double * outputs) {
+
+	const struct NNetwork * network = ctx -> network;
+	const struct NNvertex * vertices = (const void *)network -> contents, * vertex;
+	const struct NNedge * edges = (const void *)(vertices + network -> vertices), * edge;
+
+	unsigned int ins = network -> inputs, s = ctx -> steps, i;
+	double * values = ctx -> values, value;
+
+	values[0] = 1;
+
+	for (i = 0; i < ins; i++)
+		values[i + 1] = inputs[i];
+
+	for (i = 0; i < s; i++) {
+		vertex = ctx -> order[i];
+		value = 0;
+
+		for (edge = NN_EDGE(edges, vertex -> edges[NN_BACKWARD]); edge != NULL; edge = NN_EDGE(edges, edge -> next[NN_BACKWARD]))
+			if (!edge -> flag)
+				value += edge -> weight * values[edge -> vertices[NN_BACKWARD]];
+
+		if (vertex -> layer_index == (unsigned int)-1) {
+			outputs[vertex - vertices - ins - 1] = value;
+		} else {
+			values[vertex - vertices] = activ_table[vertex -> activ_index](value);
+		}
 	}
 
-	NNfree_iter(iter);
 	return 0;
+}
+
+
+/*
+	free the inference context
+
+	ctx -- the context to free
+*/
+
+void NNfree_ctx(struct NNctx * ctx) {
+
+	free(ctx);
+	return;
 }
\ No newline at end of file
@@ -1,10 +1,20 @@
 #ifndef __PREDICT_H
 #define __PREDICT_H
 
+#include <stddef.h>
+
 #include "model.h"
 
 
+struct NNctx;
+
+
 int NNpredict(struct NNetwork * network, const double * inputs, double * outputs);
+int NNpredict_batch(struct NNetwork * network, const double * inputs, size_t n, double * outputs);
+
+struct NNctx * NNget_ctx(const struct NNetwork * network);
+int NNpredict_ctx(struct NNctx * ctx, const double * inputs, double * outputs);
+void NNfree_ctx(struct NNctx * ctx);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "quant.h"
+
+
+extern int NNdebug;
+
+
+static void NNcalibrate(const struct NNplan * plan, double ** set, size_t size, double * pre, double * post, double * values);
+static void NNrequant_factor(double factor, int32_t * multiplier, int * shift);
+
+static inline int8_t NNrequant(int32_t acc, int32_t multiplier, int shift, int32_t floor);
+static inline int8_t NNsaturate(double x);
+
+
+/*
+	quantize the neural network into an 8-bit integer inference model
+
+	network -- the neural network to quantize, it is only read
+	set -- the calibration samples in the form double[size][inputs + outputs], as the train_set of NNparam (only the inputs are used)
+	size -- the entries of the calibration set
+
+	return the model on success, NULL if OOM
+
+	note: the calibration runs the double model over the set and records the greatest magnitude of every vertex, which gives its activation scale (magnitude / 127). The source scale is folded into every incoming weight and the results are quantized per vertex, so a vertex accumulates int8 x int8 products into an int32 and needs one fixed-point multiplier to get back to int8. identity and relu are applied by that requantization (relu clamps at the quantized -1), any other activation goes through a 256 entry table of the vertex indexed by its quantized pre-activation.
+*/
+
+struct NNplan_q8 * NNquantize(const struct NNetwork * network, double ** set, size_t size) {
+
+	struct NNplan * plan = NULL;
+	struct NNplan_q8 * model = NULL;
+	double * pre = NULL, * post, * values;
+
+	if ((plan = NNcompile_dense(network, NN_NO_DENSE)) == NULL)
+		goto fail;
+
+	unsigned int ins = plan -> inputs, v = plan -> vertices, s = plan -> steps, l = plan -> links, hidden = s - plan -> outputs, tables = 0, vertex, i, k;
+	int q;
+
+	if ((pre = calloc(3 * (size_t)v, sizeof(double))) == NULL)
+		goto fail;
+
+	post = pre + v,
+	values = post + v;
+
+	NNcalibrate(plan, set, size, pre, post, values);
+
+	for (i = 0; i < v; i++)
+		post[i] = (post[i] > 0) ? post[i] / 127 : 1.0 / 127,
+		pre[i] = (pre[i] > 0) ? pre[i] / 127 : 1.0 / 127;
+
+	for (i = 0; i < hidden; i++)
+		if ((plan -> step[i].activ_index != _identity) && (plan -> step[i].activ_index != _relu))
+			tables++;
+
+	if ((model = malloc(sizeof(struct NNplan_q8) + s * sizeof(struct NNqstep) + ins * sizeof(double) + l * sizeof(unsigned int) + l + 256 * (size_t)tables)) == NULL)
+		goto fail;
+
+	model -> inputs = ins,
+	model -> outputs = plan -> outputs,
+	model -> vertices = v,
+	model -> steps = s,
+	model -> links = l;
+
+	model -> step = (void *)model -> contents,
+	model -> scale = (void *)(model -> step + s),
+	model -> source = (void *)(model -> scale + ins),
+	model -> weight = (void *)(model -> source + l);
+
+	int8_t * table = model -> weight + l;
+
+	for (i = 0; i < ins; i++)
+		model -> scale[i] = post[i + 1];
+
+	double scale, weight;
+	struct NNqstep * step = model -> step;
+
+	for (i = 0, k = 0; i < s; i++) {
+
+		unsigned int first = k;
+
+		for (scale = 0; k < plan -> step[i].links; k++)
+			if ((weight = fabs(plan -> link[k].weight * post[plan -> link[k].vertex])) > scale)
+				scale = weight;
+
+		scale = (scale > 0) ? scale / 127 : 1;
+
+		for (k = first; k < plan -> step[i].links; k++)
+			model -> source[k] = plan -> link[k].vertex,
+			model -> weight[k] = NNsaturate(plan -> link[k].weight * post[plan -> link[k].vertex] / scale);
+
+		step[i].vertex = (vertex = plan -> step[i].vertex),
+		step[i].links = k,
+		step[i].activ_index = plan -> step[i].activ_index,
+		step[i].scale = scale,
+		step[i].floor = -127,
+		step[i].table = NULL;
+
+		if (i >= hidden) {
+			step[i].multiplier = 0, step[i].shift = 0;
+			continue;
+		}
+
+		switch (step[i].activ_index) {
+			case _relu :
+				step[i].floor = NNsaturate(-1 / post[vertex]);
+				/* fall through */
+			case _identity :
+				NNrequant_factor(scale / post[vertex], & step[i].multiplier, & step[i].shift);
+				break;
+
+			default :
+				NNrequant_factor(scale / pre[vertex], & step[i].multiplier, & step[i].shift);
+
+				for (q = -128; q < 128; q++)
+					table[q + 128] = NNsaturate(activ_table[step[i].activ_index](q * pre[vertex]) / post[vertex]);
+
+				step[i].table = table;
+				table += 256;
+				break;
+		}
+	}
+
+	free(pre);
+	NNfree_plan(plan);
+
+	return model;
+
+fail:
+	if (pre != NULL)
+		free(pre);
+
+	if (plan != NULL)
+		NNfree_plan(plan);
+
+	return NULL;
+}
+
+
+/*
+	free the 8-bit integer model
+
+	model -- the model to free
+*/
+
+void NNfree_q8(struct NNplan_q8 * model) {
+
+	free(model);
+	return;
+}
+
+
+/*
+	predict the outputs by provided inputs using an 8-bit integer model
+
+	model -- the model quantized by NNquantize
+	inputs -- the inputs for the model
+	outputs -- the address to store an array of outputs
+
+	return 0 on success, -1 on failed (OOM).
+
+	note: inputs are quantized by their calibrated scale and outputs are dequantized from the accumulators, everything in between is integer arithmetic. The values are kept as in NNpredict_plan, the model is only read and may be shared by many threads.
+*/
+
+int NNpredict_q8(const struct NNplan_q8 * model, const double * inputs, double * outputs) {
+
+	unsigned int ins = model -> inputs, s = model -> steps, hidden = s - model -> outputs, i, k = 0;
+	int8_t stack[NN_STACK], * values = (model -> vertices <= NN_STACK) ? stack : malloc(model -> vertices), q;
+	int32_t acc;
+
+	const struct NNqstep * step = model -> step;
+	const unsigned int * source = model -> source;
+	const int8_t * weight = model -> weight;
+
+	if (values == NULL)
+		return -1;
+
+	values[0] = 127;
+
+	for (i = 0; i < ins; i++)
+		values[i + 1] = NNsaturate(inputs[i] / model -> scale[i]);
+
+	for (i = 0; i < hidden; i++) {
+
+		for (acc = 0; k < step[i].links; k++)
+			acc += weight[k] * values[source[k]];
+
+		q = NNrequant(acc, step[i].multiplier, step[i].shift, step[i].floor);
+		values[step[i].vertex] = (step[i].table != NULL) ? step[i].table[q + 128] : q;
+	}
+
+	for (; i < s; i++) {
+
+		for (acc = 0; k < step[i].links; k++)
+			acc += weight[k] * values[source[k]];
+
+		outputs[i - hidden] = acc * step[i].scale;
+	}
+
+	if (values != stack)
+		free(values);
+
+	return 0;
+}
+
+
+/*
+	run the compiled network over the calibration set and record the greatest magnitudes
+
+	plan -- the compiled network
+	set -- the calibration samples in the form double[size][inputs + outputs]
+	size -- the entries of the set
+	pre -- where to record the magnitude of every vertex before activation
+	post -- where to record the magnitude of every vertex after activation
+	values -- the scratch space for the activated values, double[vertices]
+*/
+
+void NNcalibrate(const struct NNplan * plan, double ** set, size_t size, double * pre, double * post, double * values) {
+
+	unsigned int ins = plan -> inputs, s = plan -> steps, hidden = s - plan -> outputs, vertex, i, k;
+	size_t j;
+	double (* samples)[ins + plan -> outputs] = (double (*)[ins + plan -> outputs])set, value;
+
+	const struct NNstep * step = plan -> step;
+	const struct NNlink * link = plan -> link;
+
+	values[0] = 1, post[0] = 1;
+
+	for (j = 0; j < size; j++) {
+
+		for (i = 0; i < ins; i++) {
+			values[i + 1] = samples[j][i];
+			if (fabs(values[i + 1]) > post[i + 1])
+				post[i + 1] = fabs(values[i + 1]);
+		}
+
+		for (i = 0, k = 0; i < hidden; i++) {
+
+			for (value = 0; k < step[i].links; k++)
+				value += link[k].weight * values[link[k].vertex];
+
+			vertex = step[i].vertex;
+			values[vertex] = step[i].activate(value);
+
+			if (fabs(value) > pre[vertex])
+				pre[vertex] = fabs(value);
+
+			if (fabs(values[vertex]) > post[vertex])
+				post[vertex] = fabs(values[vertex]);
+		}
+	}
+
+	return;
+}
+
+
+/*
+	express a positive real factor as a 32-bit fixed-point multiplier and a right shift
+
+	factor -- the factor to express
+	multiplier -- where to store the multiplier (in [2^30, 2^31))
+	shift -- where to store the right shift, factor ~ multiplier / 2^shift
+*/
+
+void NNrequant_factor(double factor, int32_t * multiplier, int * shift) {
+
+	int exponent;
+	int64_t m = (int64_t)(frexp(factor, & exponent) * 2147483648.0 + 0.5);
+
+	if (m == ((int64_t)1 << 31))
+		m >>= 1, exponent++;
+
+	*multiplier = (int32_t)m,
+	*shift = 31 - exponent;
+
+	if (*shift > 62) {
+		*multiplier = 0, *shift = 0;
+	} else if (*shift < 0) {
+		*multiplier = INT32_MAX, *shift = 0;
+	}
+
+	return;
+}
+
+
+/*
+	requantize an int32 accumulator into int8 by a fixed-point multiplier, rounding to nearest and saturating to [floor, 127]
+*/
+
+int8_t NNrequant(int32_t acc, int32_t multiplier, int shift, int32_t floor) {
+
+	int64_t p = (int64_t)acc * multiplier;
+
+	if (shift > 0)
+		p = (p + ((int64_t)1 << (shift - 1))) >> shift;
+
+	if (p < floor)
+		return (int8_t)floor;
+
+	if (p > 127)
+		return 127;
+
+	return (int8_t)p;
+}
+
+
+/*
+	round a real number to the nearest int8 in [-127, 127]
+*/
+
+int8_t NNsaturate(double x) {
+
+	if (x >= 127)
+		return 127;
+
+	if (x <= -127)
+		return -127;
+
+	return (int8_t)((x < 0) ? -(int)(0.5 - x) : (int)(x + 0.5));
+}
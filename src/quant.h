@@ -0,0 +1,36 @@
+#ifndef __QUANT_H
+#define __QUANT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "plan.h"
+
+
+struct NNplan_q8;
+struct NNqstep;
+
+struct NNplan_q8 {
+	unsigned int inputs, outputs, vertices, steps, links;
+	struct NNqstep * step;
+	double * scale;
+	unsigned int * source;
+	int8_t * weight;
+	char contents[];
+};
+
+struct NNqstep {
+	unsigned int vertex, links;
+	int activ_index, shift;
+	int32_t multiplier, floor;
+	double scale;
+	const int8_t * table;
+};
+
+struct NNplan_q8 * NNquantize(const struct NNetwork * network, double ** set, size_t size);
+void NNfree_q8(struct NNplan_q8 * model);
+
+int NNpredict_q8(const struct NNplan_q8 * model, const double * inputs, double * outputs);
+
+
+#endif
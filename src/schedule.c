@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "schedule.h"
+#include "iter.h"
+
+
+#define NN_ALIGN 16
+
+
+extern int NNdebug;
+
+
+static struct NNschedule * NNbuild_schedule(const struct NNetwork * network);
+static size_t NNschedule_size(const unsigned int * n, const unsigned int * m);
+static struct NNschedule * NNlay_schedule(const struct NNetwork * network, struct NNschedule * schedule, const unsigned int * n, const unsigned int * m, const unsigned char * seen);
+static unsigned int NNreach(const struct NNetwork * network, bool direction, unsigned char * seen, unsigned int * stack, unsigned int * reached);
+
+static int NNforward_compare(const void * element1, const void * element2);
+static int NNbackward_compare(const void * element1, const void * element2);
+
+
+/*
+	get the traversal schedule of the neural network, building it if the network has none
+
+	network -- the neural network to traverse
+
+	return the schedule on success, NULL if OOM
+
+	note: the schedule is cached in the network and shared by every traversal until NNinvalidate_schedule. It is built on first use, so a network shared by many threads should get its schedule before they start.
+*/
+
+struct NNschedule * NNget_schedule(struct NNetwork * network) {
+
+	if (network -> schedule == NULL)
+		network -> schedule = NNbuild_schedule(network);
+
+	return network -> schedule;
+}
+
+
+/*
+	drop the cached schedule of the neural network
+
+	network -- the neural network whose topology or edge flags changed
+
+	note: NNtruncate, NNfission and NNfusion return networks without a schedule, NNload and NNcopy as well. Callers changing edges or flags by hand must invalidate the schedule themselves.
+*/
+
+void NNinvalidate_schedule(struct NNetwork * network) {
+
+	if (network -> schedule != NULL)
+		free(network -> schedule);
+
+	network -> schedule = NULL;
+	return;
+}
+
+
+/*
+	build the traversal schedule of the neural network
+
+	network -- the neural network to traverse
+
+	return the schedule on success, NULL if OOM
+
+	note: the forward schedule holds the inputs and every vertex reachable from them or from the bias through edges with flag 0 (the bias itself and its edges are not scheduled forward), the backward schedule the outputs and every vertex other than layer 0 reachable backward from them, both sorted by layer_index (ascending forward, descending backward) then position, and bucketed by layer in layer[direction]. The edges of the k-th vertex are edge[direction][first[direction][k]] up to first[direction][k + 1]: its outgoing edges forward, its incoming edges backward, in list order and without flagged edges. Every vertex and edge appears at most once in each direction.
+*/
+
+struct NNschedule * NNbuild_schedule(const struct NNetwork * network) {
+
+	unsigned int v = network -> vertices, n[2], m[2];
+	int d;
+
+	struct NNschedule * schedule = NULL;
+	unsigned int * stack = NULL;
+	unsigned char * seen;
+
+	if ((stack = malloc(v * sizeof(unsigned int) + 2 * (size_t)v)) == NULL)
+		return NULL;
+
+	seen = (void *)(stack + v);
+
+	for (d = 0; d < 2; d++)
+		n[d] = NNreach(network, d, seen + d * (size_t)v, stack, m + d);
+
+	if ((schedule = malloc(NNschedule_size(n, m))) != NULL)
+		NNlay_schedule(network, schedule, n, m, seen);
+
+	free(stack);
+
+	return schedule;
+}
+
+
+/*
+	find the size of memory NNplace_schedule needs for the neural network, without traversing it
+
+	network -- the neural network to schedule
+
+	return the size in bytes, enough for any schedule of a network of this many vertices and edges
+*/
+
+size_t NNschedule_bound(const struct NNetwork * network) {
+
+	unsigned int n[2] = {network -> vertices, network -> vertices}, m[2] = {network -> edges, network -> edges};
+
+	return network -> vertices * sizeof(unsigned int) + 2 * (size_t)network -> vertices + NN_ALIGN + NNschedule_size(n, m);
+}
+
+
+/*
+	build the traversal schedule of the neural network inside given memory, as NNbuild_schedule
+
+	network -- the neural network to schedule, it is only read
+	memory -- where to build the schedule
+	size -- the size of memory, at least NNschedule_bound(network)
+
+	return the schedule (inside memory) on success, NULL if memory is too small
+
+	note: nothing is allocated and the network does not keep the schedule, so many threads may schedule one network at the same time with their own memory
+*/
+
+struct NNschedule * NNplace_schedule(const struct NNetwork * network, void * memory, size_t size) {
+
+	unsigned int v = network -> vertices, n[2], m[2];
+	int d;
+
+	unsigned int * stack = memory;
+	unsigned char * seen = (void *)(stack + v);
+	uintptr_t p = (uintptr_t)(seen + 2 * (size_t)v);
+
+	if (size < NNschedule_bound(network))
+		return NULL;
+
+	for (d = 0; d < 2; d++)
+		n[d] = NNreach(network, d, seen + d * (size_t)v, stack, m + d);
+
+	p = (p + NN_ALIGN - 1) & ~(uintptr_t)(NN_ALIGN - 1);
+
+	return NNlay_schedule(network, (void *)p, n, m, seen);
+}
+
+
+/*
+	find the size of a schedule
+
+	n -- the number of vertices in each direction
+	m -- the number of edges in each direction
+*/
+
+size_t NNschedule_size(const unsigned int * n, const unsigned int * m) {
+
+	size_t size = sizeof(struct NNschedule);
+	int d;
+
+	for (d = 0; d < 2; d++)
+		size += n[d] * sizeof(struct NNvertex *) + m[d] * sizeof(struct NNedge *) + 2 * ((size_t)n[d] + 1) * sizeof(unsigned int);
+
+	return size;
+}
+
+
+/*
+	lay out and fill a schedule in given memory
+
+	network -- the neural network to schedule
+	schedule -- the memory for the schedule, NNschedule_size(n, m) bytes
+	n -- the number of vertices reached in each direction
+	m -- the number of edges reached in each direction
+	seen -- the vertices reached, unsigned char[2][vertices] as marked by NNreach
+
+	return schedule
+*/
+
+struct NNschedule * NNlay_schedule(const struct NNetwork * network, struct NNschedule * schedule, const unsigned int * n, const unsigned int * m, const unsigned char * seen) {
+
+	unsigned int v = network -> vertices, i, k, l;
+	int d;
+
+	struct NNvertex * vertices = (void *)network -> contents, * vertex;
+	struct NNedge * edges = (void *)(vertices + v), * edge;
+	char * p = schedule -> contents;
+
+	for (d = 0; d < 2; d++) {
+		schedule -> vertices[d] = n[d], schedule -> edges[d] = m[d];
+		schedule -> vertex[d] = (void *)p, p += n[d] * sizeof(struct NNvertex *);
+		schedule -> edge[d] = (void *)p, p += m[d] * sizeof(struct NNedge *);
+	}
+
+	for (d = 0; d < 2; d++) {
+		schedule -> first[d] = (void *)p, p += ((size_t)n[d] + 1) * sizeof(unsigned int);
+		schedule -> layer[d] = (void *)p, p += ((size_t)n[d] + 1) * sizeof(unsigned int);
+	}
+
+	for (d = 0; d < 2; d++) {
+
+		for (i = 0, k = 0; i < v; i++)
+			if (seen[d * (size_t)v + i])
+				schedule -> vertex[d][k++] = vertices + i;
+
+		qsort(schedule -> vertex[d], n[d], sizeof(struct NNvertex *), d ? & NNbackward_compare : & NNforward_compare);
+
+		for (k = 0, i = 0, l = 0; k < n[d]; k++) {
+			vertex = schedule -> vertex[d][k];
+
+			if ((k == 0) || (vertex -> layer_index != schedule -> vertex[d][k - 1] -> layer_index))
+				schedule -> layer[d][l++] = k;
+
+			schedule -> first[d][k] = i;
+
+			for (edge = NN_EDGE(edges, vertex -> edges[d]); edge != NULL; edge = NN_EDGE(edges, edge -> next[d]))
+				if (!edge -> flag)
+					schedule -> edge[d][i++] = edge;
+		}
+
+		schedule -> first[d][n[d]] = i;
+		schedule -> layer[d][l] = n[d];
+		schedule -> layers[d] = l;
+	}
+
+	return schedule;
+}
+
+
+/*
+	mark the vertices reached by a traversal of the neural network
+
+	network -- the neural network to traverse
+	direction -- NN_FORWARD from the inputs and the bias, NN_BACKWARD from the outputs
+	seen -- where to mark the reached vertices, unsigned char[vertices]
+	stack -- the scratch space, unsigned int[vertices]
+	reached -- where to store the number of edges the reached vertices pass on
+
+	return the number of vertices reached
+*/
+
+unsigned int NNreach(const struct NNetwork * network, bool direction, unsigned char * seen, unsigned int * stack, unsigned int * reached) {
+
+	unsigned int v = network -> vertices, first = direction ? network -> inputs + 1 : 1, last = direction ? network -> inputs + network -> outputs : network -> inputs, top = 0, n = 0, next, i;
+	const struct NNvertex * vertices = (const void *)network -> contents;
+	const struct NNedge * edges = (const void *)(vertices + v), * edge;
+
+	for (i = 0; i < v; i++)
+		seen[i] = 0;
+
+	for (i = first; i <= last; i++)
+		seen[i] = 1, stack[top++] = i;
+
+	if (direction == NN_FORWARD)
+		for (edge = NN_EDGE(edges, vertices[0].edges[NN_FORWARD]); edge != NULL; edge = NN_EDGE(edges, edge -> next[NN_FORWARD]))
+			if (!edge -> flag && (vertices[edge -> vertices[NN_FORWARD]].layer_index != 0) && !seen[edge -> vertices[NN_FORWARD]])
+				seen[edge -> vertices[NN_FORWARD]] = 1, stack[top++] = edge -> vertices[NN_FORWARD];
+
+	* reached = 0;
+
+	while (top > 0) {
+		i = stack[--top], n++;
+
+		for (edge = NN_EDGE(edges, vertices[i].edges[direction]); edge != NULL; edge = NN_EDGE(edges, edge -> next[direction])) {
+			if (edge -> flag)
+				continue;
+
+			(* reached)++;
+			next = edge -> vertices[direction];
+
+			if ((vertices[next].layer_index == 0) || seen[next])
+				continue;
+
+			seen[next] = 1, stack[top++] = next;
+		}
+	}
+
+	return n;
+}
+
+
+/*
+	compare two vertices by ascending layer_index then position, for qsort
+*/
+
+int NNforward_compare(const void * element1, const void * element2) {
+
+	const struct NNvertex * a = *(const struct NNvertex * const *)element1, * b = *(const struct NNvertex * const *)element2;
+
+	if (a -> layer_index != b -> layer_index)
+		return (a -> layer_index > b -> layer_index) - (a -> layer_index < b -> layer_index);
+
+	return (a > b) - (a < b);
+}
+
+
+/*
+	compare two vertices by descending layer_index then position, for qsort
+*/
+
+int NNbackward_compare(const void * element1, const void * element2) {
+
+	const struct NNvertex * a = *(const struct NNvertex * const *)element1, * b = *(const struct NNvertex * const *)element2;
+
+	if (a -> layer_index != b -> layer_index)
+		return (a -> layer_index < b -> layer_index) - (a -> layer_index > b -> layer_index);
+
+	return (a > b) - (a < b);
+}
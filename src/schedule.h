@@ -0,0 +1,26 @@
+#ifndef __SCHEDULE_H
+#define __SCHEDULE_H
+
+#include <stddef.h>
+
+#include "model.h"
+
+
+struct NNschedule;
+
+struct NNschedule {
+	unsigned int layers[2], vertices[2], edges[2];
+	unsigned int * layer[2], * first[2];
+	struct NNvertex ** vertex[2];
+	struct NNedge ** edge[2];
+	char contents[];
+};
+
+struct NNschedule * NNget_schedule(struct NNetwork * network);
+void NNinvalidate_schedule(struct NNetwork * network);
+
+size_t NNschedule_bound(const struct NNetwork * network);
+struct NNschedule * NNplace_schedule(const struct NNetwork * network, void * memory, size_t size);
+
+
+#endif
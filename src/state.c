@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "state.h"
+#include "binary.h"
+
+
+extern int NNdebug;
+
+
+/*
+	save the state of a training between two stages
+
+	file -- the filename of the state (pathname)
+	state -- the stage, the loop state, the parameters and the random state of the training
+	network -- the network to train in the next stage
+	backup -- the network of the last stage kept by NNtrain, NULL if none
+
+	return 0 on success, -1 on failure. errno set by fclose > NNwrite_bin > fwrite > fopen
+
+	note: the file is a struct NNstate_header, the struct NNstate, then network and backup in the binary format (see NNsave_bin). checksum covers the struct NNstate, the models carry their own.
+*/
+
+int NNsave_state(const char * file, const struct NNstate * state, const struct NNetwork * network, const struct NNetwork * backup) {
+
+	FILE * fp = NULL;
+	struct NNstate_header header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NN_STATE_MAGIC, sizeof(NN_STATE_MAGIC));
+	header.version = NN_STATE_VERSION,
+	header.endian = NN_BIN_ENDIAN,
+	header.state_size = sizeof(struct NNstate),
+	header.backup = (backup != NULL),
+	header.checksum = NNchecksum(NN_BIN_SEED, state, sizeof(struct NNstate));
+
+	if ((fp = fopen(file, "wb")) == NULL)
+		goto fail;
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		goto fail;
+
+	if (fwrite(state, sizeof(struct NNstate), 1, fp) != 1)
+		goto fail;
+
+	if (NNwrite_bin(network, fp) == -1)
+		goto fail;
+
+	if (backup != NULL)
+		if (NNwrite_bin(backup, fp) == -1)
+			goto fail;
+
+	if (fclose(fp) == EOF) {
+		fp = NULL;
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	if (fp != NULL)
+		fclose(fp);
+
+	return -1;
+}
+
+
+/*
+	load the state of a training saved by NNsave_state
+
+	file -- the filename of the state (pathname)
+	state -- where to store the stage, the loop state, the parameters and the random state
+	network -- where to store the network to train in the next stage
+	backup -- where to store the network of the last stage, NULL if none was saved
+
+	return 0 on success, -1 on failure. errno set by NNread_bin > fopen, EINVAL if the file is not a valid state of this build
+*/
+
+int NNload_state(const char * file, struct NNstate * state, struct NNetwork ** network, struct NNetwork ** backup) {
+
+	FILE * fp = NULL;
+	struct NNstate_header header;
+
+	* network = NULL, * backup = NULL;
+
+	if ((fp = fopen(file, "rb")) == NULL)
+		goto fail;
+
+	if ((fread(&header, sizeof(header), 1, fp) != 1) || (fread(state, sizeof(struct NNstate), 1, fp) != 1))
+		goto invalid;
+
+	if (memcmp(header.magic, NN_STATE_MAGIC, sizeof(NN_STATE_MAGIC)) || (header.version != NN_STATE_VERSION) || (header.endian != NN_BIN_ENDIAN) ||
+		(header.state_size != sizeof(struct NNstate)) || (header.backup > 1) || (NNchecksum(NN_BIN_SEED, state, sizeof(struct NNstate)) != header.checksum))
+		goto invalid;
+
+	if ((* network = NNread_bin(fp)) == NULL)
+		goto fail;
+
+	if (header.backup)
+		if ((* backup = NNread_bin(fp)) == NULL)
+			goto fail;
+
+	fclose(fp);
+
+	return 0;
+
+invalid:
+	errno = EINVAL;
+
+fail:
+	if (fp != NULL)
+		fclose(fp);
+
+	if (* network != NULL)
+		NNfree(* network), * network = NULL;
+
+	return -1;
+}
@@ -0,0 +1,32 @@
+#ifndef __STATE_H
+#define __STATE_H
+
+#include <stdint.h>
+
+#include "model.h"
+
+#define NN_STATE_MAGIC "NNstate"
+#define NN_STATE_VERSION 1
+
+
+struct NNstate_header;
+struct NNstate;
+
+struct NNstate_header {
+	char magic[8];
+	uint32_t version, endian, state_size, backup;
+	uint64_t checksum;
+};
+
+struct NNstate {
+	uint32_t stage;
+	int32_t freeze_steps, activ_index, tolerance;
+	double general_cost, step_size, freeze_hold, vanish_hold, reaction_hold;
+	uint64_t random;
+};
+
+int NNsave_state(const char * file, const struct NNstate * state, const struct NNetwork * network, const struct NNetwork * backup);
+int NNload_state(const char * file, struct NNstate * state, struct NNetwork ** network, struct NNetwork ** backup);
+
+
+#endif
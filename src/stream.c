@@ -0,0 +1,275 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "stream.h"
+
+
+extern int NNdebug;
+
+
+struct NNslot {
+	double * rows;
+	long count;
+	unsigned int left;
+	bool full, held;
+};
+
+struct NNcursor {
+	double * rows;
+	long next, count;
+	int slot;
+};
+
+struct NNstream {
+	NNsource source;
+	void * context;
+	size_t batch;
+	unsigned int width, readers, slots, fill, take;
+	bool quit;
+	struct NNslot * slot;
+	struct NNcursor * cursor;
+	pthread_mutex_t lock;
+	pthread_cond_t filled, emptied;
+	pthread_t thread;
+};
+
+static void * NNstream_producer(void * arg);
+static long NNstream_take(struct NNstream * stream, struct NNcursor * cursor);
+
+
+/*
+	start prefetching samples from a source
+
+	source -- the source of the samples, see NNsource
+	context -- the argument for source
+	batch -- the samples asked from source at a time, 0 for NN_STREAM_BATCH
+	width -- the inputs plus the outputs of a sample
+	readers -- the number of threads reading the stream, 0 is treated as 1
+
+	return the stream on success, NULL on failed (OOM or the thread can not be created)
+
+	note: a thread fills readers + 1 batches in turn, so the source works while every reader propagates a batch of its own. The readers share one pass of the source, each batch goes to the first reader asking for it.
+*/
+
+struct NNstream * NNstream_start(NNsource source, void * context, size_t batch, unsigned int width, unsigned int readers) {
+
+	struct NNstream * stream = NULL;
+	double * rows;
+	unsigned int i, slots;
+
+	if (batch == 0)
+		batch = NN_STREAM_BATCH;
+
+	if (readers == 0)
+		readers = 1;
+
+	slots = readers + 1;
+
+	if ((stream = malloc(sizeof(struct NNstream) + slots * sizeof(struct NNslot) + readers * sizeof(struct NNcursor) + slots * batch * width * sizeof(double))) == NULL)
+		return NULL;
+
+	stream -> source = source,
+	stream -> context = context,
+	stream -> batch = batch,
+	stream -> width = width,
+	stream -> readers = readers,
+	stream -> slots = slots,
+	stream -> fill = 0,
+	stream -> take = 0,
+	stream -> quit = false,
+	stream -> slot = (struct NNslot *)(stream + 1),
+	stream -> cursor = (struct NNcursor *)(stream -> slot + slots);
+
+	for (i = 0, rows = (double *)(void *)(stream -> cursor + readers); i < slots; i++, rows += batch * width)
+		stream -> slot[i].rows = rows,
+		stream -> slot[i].count = 0,
+		stream -> slot[i].left = 0,
+		stream -> slot[i].full = false,
+		stream -> slot[i].held = false;
+
+	for (i = 0; i < readers; i++)
+		stream -> cursor[i].rows = NULL,
+		stream -> cursor[i].next = 0,
+		stream -> cursor[i].count = 0,
+		stream -> cursor[i].slot = -1;
+
+	if (pthread_mutex_init(&stream -> lock, NULL))
+		goto fail_lock;
+
+	if (pthread_cond_init(&stream -> filled, NULL))
+		goto fail_filled;
+
+	if (pthread_cond_init(&stream -> emptied, NULL))
+		goto fail_emptied;
+
+	if (pthread_create(&stream -> thread, NULL, & NNstream_producer, stream))
+		goto fail;
+
+	return stream;
+
+fail:
+	pthread_cond_destroy(&stream -> emptied);
+fail_emptied:
+	pthread_cond_destroy(&stream -> filled);
+fail_filled:
+	pthread_mutex_destroy(&stream -> lock);
+fail_lock:
+	free(stream);
+	return NULL;
+}
+
+
+/*
+	stop prefetching and free the stream
+
+	stream -- the stream to stop, no reader may still use it
+
+	note: waits for a call of the source in flight, the batches prefetched and not read are lost
+*/
+
+void NNstream_stop(struct NNstream * stream) {
+
+	pthread_mutex_lock(&stream -> lock);
+	stream -> quit = true;
+	pthread_cond_signal(&stream -> emptied);
+	pthread_mutex_unlock(&stream -> lock);
+
+	pthread_join(stream -> thread, NULL);
+
+	pthread_cond_destroy(&stream -> emptied);
+	pthread_cond_destroy(&stream -> filled);
+	pthread_mutex_destroy(&stream -> lock);
+
+	free(stream);
+	return;
+}
+
+
+/*
+	get the next sample of a reader from the stream
+
+	stream -- the stream to read
+	reader -- the index of the reader, below the readers of NNstream_start, one thread for each
+	row -- where to store the sample, double[width] valid until the next call of the reader
+
+	return 1 if a sample is stored, 0 at the end of a pass, -1 if the source failed
+
+	note: every reader gets the end of a pass once, after the last batch of the pass is given out. The next pass starts only after all the readers got it, so they must not read on before they all finished the pass.
+*/
+
+int NNstream_row(struct NNstream * stream, unsigned int reader, double ** row) {
+
+	struct NNcursor * cursor = stream -> cursor + reader;
+	long count;
+
+	if (cursor -> next >= cursor -> count) {
+		if ((count = NNstream_take(stream, cursor)) <= 0)
+			return (count < 0) ? -1 : 0;
+	}
+
+	* row = cursor -> rows + cursor -> next++ * stream -> width;
+
+	return 1;
+}
+
+
+/*
+	give the batch of a reader back and take the next one
+
+	stream -- the stream read
+	cursor -- the cursor of the reader
+
+	return the samples in the batch taken, 0 at the end of a pass, -1 if the source failed
+
+	note: a batch taken is held until its reader takes the next one, so the producer does not refill it and no other reader takes it while it is read. The end of a pass stays at the head until every reader took it, a failure stays for good
+*/
+
+long NNstream_take(struct NNstream * stream, struct NNcursor * cursor) {
+
+	struct NNslot * slot;
+	long count;
+
+	pthread_mutex_lock(&stream -> lock);
+
+	if (cursor -> slot >= 0) {
+		stream -> slot[cursor -> slot].held = false;
+		pthread_cond_signal(&stream -> emptied);
+	}
+
+	cursor -> rows = NULL,
+	cursor -> next = 0,
+	cursor -> count = 0,
+	cursor -> slot = -1;
+
+	while (!(slot = stream -> slot + stream -> take) -> full)
+		pthread_cond_wait(&stream -> filled, &stream -> lock);
+
+	if ((count = slot -> count) > 0) {
+		slot -> full = false,
+		slot -> held = true;
+
+		cursor -> rows = slot -> rows,
+		cursor -> count = count,
+		cursor -> slot = stream -> take;
+
+		stream -> take = (stream -> take + 1) % stream -> slots;
+	} else if ((count == 0) && (--slot -> left == 0)) {
+		slot -> full = false;
+		pthread_cond_signal(&stream -> emptied);
+
+		stream -> take = (stream -> take + 1) % stream -> slots;
+	}
+
+	pthread_mutex_unlock(&stream -> lock);
+
+	return count;
+}
+
+
+/*
+	the producer thread of a stream
+
+	arg -- the stream
+
+	note: the producer fills the empty batches in turn until the stream stops or the source fails. A batch of count 0 marks the end of a pass, the producer goes on with the next pass.
+*/
+
+void * NNstream_producer(void * arg) {
+
+	struct NNstream * stream = arg;
+	struct NNslot * slot;
+	long count;
+
+	pthread_mutex_lock(&stream -> lock);
+
+	while (true) {
+		while (((slot = stream -> slot + stream -> fill) -> full || slot -> held) && !stream -> quit)
+			pthread_cond_wait(&stream -> emptied, &stream -> lock);
+
+		if (stream -> quit)
+			break;
+
+		pthread_mutex_unlock(&stream -> lock);
+
+		if ((count = stream -> source(stream -> context, slot -> rows, stream -> batch)) > (long)stream -> batch)
+			count = -1;
+
+		pthread_mutex_lock(&stream -> lock);
+		slot -> count = count,
+		slot -> left = stream -> readers,
+		slot -> full = true;
+		pthread_cond_broadcast(&stream -> filled);
+
+		if (count < 0)
+			break;
+
+		stream -> fill = (stream -> fill + 1) % stream -> slots;
+	}
+
+	pthread_mutex_unlock(&stream -> lock);
+
+	return NULL;
+}
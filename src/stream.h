@@ -0,0 +1,20 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include <stddef.h>
+
+#include "train.h"
+
+#define NN_STREAM_BATCH 256
+
+
+struct NNstream;
+
+
+struct NNstream * NNstream_start(NNsource source, void * context, size_t batch, unsigned int width, unsigned int readers);
+void NNstream_stop(struct NNstream * stream);
+
+int NNstream_row(struct NNstream * stream, unsigned int reader, double ** row);
+
+
+#endif
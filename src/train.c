@@ -1,36 +1,78 @@
 #define  _XOPEN_SOURCE_EXTENDED 1
-#include <sys/mman.h>
+#define _DEFAULT_SOURCE 1
 #include <sys/types.h>
-#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <signal.h>
-#include <sys/wait.h>
 #include <time.h>
-
-#ifdef __linux__
-#include <sys/prctl.h>
-#include <signal.h>
-#endif
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 #include "train.h"
 #include "iter.h"
+#include "csr.h"
+#include "schedule.h"
+#include "checkpoint.h"
+#include "state.h"
+#include "stream.h"
+#include "pool.h"
+
+#define NN_LINE 64
+#define NN_SCATTER_MIN 4096
+#define NN_CHUNK 64
 
 extern int NNdebug;
 
 
-static int NNtrain_core(struct NNetwork * network, unsigned int order, volatile double * post, pid_t ppid, struct NNparam * param);
-static inline void NNsync_to_core(struct NNetwork * network, volatile double * post);
-static bool test_generalization(struct NNetwork * network, double * general_cost, struct NNparam * param);
+struct NNreplica {
+	struct NNetwork * network;
+	struct NNcsr * csr;
+	size_t size;
+};
+
+struct NNblock {
+	_Alignas(NN_LINE) atomic_size_t next;
+	size_t begin, end;
+};
+
+struct NNtrainer {
+	struct NNetwork * network;
+	struct NNcsr * csr;
+	struct NNparam * param;
+	struct NNpool * pool;
+	struct NNstream * stream;
+	struct NNreplica * replica;
+	struct NNblock * block;
+	double * share;
+	size_t * index;
+	size_t share_size, stride, samples, index_size;
+	uint64_t random;
+	unsigned int cores;
+	int status;
+};
+
+static int NNtrainer_start(struct NNtrainer * trainer, const struct NNetwork * network, struct NNparam * param);
+static void NNtrainer_stop(struct NNtrainer * trainer);
+static void NNtrain_task(void * arg, unsigned int id, unsigned int threads);
+static int NNtrain_core(struct NNtrainer * trainer, unsigned int order);
+static struct NNetwork * NNtrain_replica(struct NNtrainer * trainer, unsigned int order, struct NNcsr ** csr);
+static int NNtrain_sync(struct NNtrainer * trainer, unsigned int order, bool failed);
+static bool NNtrain_chunk(struct NNtrainer * trainer, unsigned int order, unsigned int * turn, size_t * pos, size_t * end);
+static bool test_generalization(struct NNetwork * network, struct NNcsr * csr, double * general_cost, struct NNparam * param);
 static struct NNetwork * NNevolve(struct NNetwork * old, struct NNparam * param);
+static struct NNetwork * NNtrain_stages(struct NNetwork * network, struct NNetwork * backup, struct NNstate * state, struct NNparam * param);
 
+static inline double * NNrow(double ** set, int type, unsigned int width, size_t index, double * buffer);
 static void NNclear_count(struct NNetwork * network);
 static void NNrelax(struct NNetwork * network, double vanish_hold);
 
-static inline int NNpropagate(struct NNetwork * network, double * init, bool direction, bool test);
-static int forward_prop(struct NNetwork * network, double * init);
-static int backward_prop(struct NNetwork * network, double * init, bool test);
+static inline int NNpropagate(struct NNetwork * network, struct NNcsr * csr, struct NNiter * iter, double * init, bool direction, bool test);
+static int forward_prop(struct NNetwork * network, struct NNiter * iter, double * init);
+static int backward_prop(struct NNetwork * network, struct NNiter * iter, double * init, bool test);
+static int forward_csr(struct NNetwork * network, struct NNcsr * csr, double * init);
+static int backward_csr(struct NNetwork * network, struct NNcsr * csr, double * init, bool test);
 
 static struct NNetwork * NNtruncate(struct NNetwork * network);
 static struct NNetwork * NNfission(struct NNetwork * network, double reaction_hold);
@@ -40,6 +82,8 @@ static int unsigned_compare(const void *element1, const void *element2);
 static int addr_compare(const void *element1, const void *element2);
 
 static inline double NNrand(double lim);
+static uint64_t NNrandom(uint64_t * state);
+static void NNshuffle(size_t * index, size_t size, uint64_t * state);
 
 
 /*
@@ -49,90 +93,167 @@ static inline double NNrand(double lim);
 	paran -- parameters uses in training the network
 
 	return the trained network on success (original network will be freed), NULL on failed.
+
+	note: with param -> checkpoint set, the network of every stage due is checkpointed after its test, and the last checkpoint is waited for before returning. With param -> state set, the whole training is checkpointed at the end of those stages, NNresume continues it.
 */
 
 struct NNetwork * NNtrain(struct NNetwork * network, struct NNparam * param) {
 
-	struct NNetwork * backup = NULL;
-	int core, i, j = 1, * status = 0;
-	size_t post_size;
-	double general_cost = -1.0, * post = NULL;
-	bool flag = 0;
+	struct NNstate state;
 
-	srand(time(0));
+	memset(&state, 0, sizeof(state));
+	state.stage = 1,
+	state.general_cost = -1.0,
+	state.random = param -> seed ? param -> seed : (uint64_t)time(0);
 
-	pid_t ppid = getpid();
+	return NNtrain_stages(network, NULL, &state, param);
+}
 
-	do {
-		if ((core = param -> core) > 0) {
 
-			post_size = (network -> edges + 3) * sizeof(double);
+/*
+	continue a training from its state
+
+	file -- the filename of the state written by NNtrain (see param -> state)
+	param -- parameters uses in training the network, as given to the training that wrote the state
+
+	return the trained network on success, NULL on failed.
+
+	note: the parameters the callback may have changed (step_size, freeze_hold, vanish_hold, reaction_hold, freeze_steps, activ_index and tolerance) are restored into param, the others are taken as given, so a training may resume with another core or layout. The stages run as the interrupted training would have run them.
+*/
+
+struct NNetwork * NNresume(const char * file, struct NNparam * param) {
+
+	struct NNstate state;
+	struct NNetwork * network, * backup;
 
-			post_size--;
-			post_size |= post_size >> 1;
-			post_size |= post_size >> 2;
-			post_size |= post_size >> 4;
-			post_size |= post_size >> 8;
-			post_size |= post_size >> 16;
-			post_size |= post_size >> 32;
-			post_size++;
+	if (NNload_state(file, &state, &network, &backup) == -1)
+		return NULL;
+
+	param -> freeze_steps = state.freeze_steps,
+	param -> activ_index = state.activ_index,
+	param -> tolerance = state.tolerance,
+	param -> step_size = state.step_size,
+	param -> freeze_hold = state.freeze_hold,
+	param -> vanish_hold = state.vanish_hold,
+	param -> reaction_hold = state.reaction_hold;
+
+	return NNtrain_stages(network, backup, &state, param);
+}
+
+
+/*
+	run the stages of a training
+
+	network -- the neural network to train in the next stage
+	backup -- the network kept from the last stage, NULL if none
+	state -- the stage index, the test cost of the last stage and the random state to start from
+	param -- parameters uses in training the network
+
+	return the trained network on success (network and backup will be freed), NULL on failed.
+
+	note: rand() is reseeded from state -> random before every stage, so a callback shuffling with rand() replays the same shuffles after NNresume
+*/
 
-			if ((post = mmap(NULL, post_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+struct NNetwork * NNtrain_stages(struct NNetwork * network, struct NNetwork * backup, struct NNstate * state, struct NNparam * param) {
+
+	struct NNcsr * csr = NULL;
+	struct NNcheckpoint * checkpoint = NULL;
+	struct NNtrainer trainer;
+	unsigned int i;
+	int j = state -> stage;
+	size_t share_size, chunks, n;
+	double general_cost = state -> general_cost;
+	bool flag = 0, due = false;
+
+	memset(&trainer, 0, sizeof(trainer));
+
+	if (NNtrainer_start(&trainer, network, param) == -1)
+		goto fail;
+
+	if (((param -> checkpoint != NULL) || (param -> state != NULL)) && ((param -> checkpoint_stages > 0) || (param -> checkpoint_seconds > 0)))
+		if ((checkpoint = NNcheckpoint_start(param -> checkpoint, param -> state, param -> checkpoint_stages, param -> checkpoint_seconds)) == NULL)
+			goto fail;
+
+	do {
+		srand((unsigned int)(NNrandom(&state -> random) >> 32));
+
+		if ((param -> layout == NN_CSR) && (csr == NULL))
+			if ((csr = NNget_csr(network)) == NULL)
 				goto fail;
 
-			pid_t children[core];
+		trainer.network = network,
+		trainer.csr = csr,
+		trainer.samples = param -> train_size,
+		trainer.status = 0;
 
-			for (i = 0; i < core; i++) {
+		chunks = (trainer.samples + NN_CHUNK - 1) / NN_CHUNK;
 
-				if (!(children[i] = fork())) {
-#ifdef __linux__
-					int r = prctl(PR_SET_PDEATHSIG, SIGTERM);
-					if (r == -1 || getppid() != ppid)
-						exit(1);
-#endif
+		for (i = 0; i < trainer.cores; i++) {
+			trainer.block[i].begin = chunks * i / trainer.cores,
+			trainer.block[i].end = chunks * (i + 1) / trainer.cores;
+			atomic_store_explicit(&trainer.block[i].next, trainer.block[i].end, memory_order_relaxed);
+		}
 
-					_exit(NNtrain_core(network, i, post, ppid, param));
-				} else if (children[i] == -1) {
+		if ((param -> batch_size > 0) && (trainer.stream == NULL)) {
 
-					int k;
-					for (k = 0; k < i; k++)
-						if (!kill(children[k], SIGTERM))
-							if (!waitpid(children[k], NULL, WNOHANG))
-								kill(children[k], SIGKILL);
+			if (trainer.samples > trainer.index_size) {
+				free(trainer.index);
+				trainer.index_size = 0;
 
+				if ((trainer.index = malloc(trainer.samples * sizeof(size_t))) == NULL)
 					goto fail;
-				}
+
+				trainer.index_size = trainer.samples;
 			}
 
-			flag = false;
+			for (n = 0; n < trainer.samples; n++)
+				trainer.index[n] = n;
+
+			trainer.random = NNrandom(&state -> random);
+		}
+
+		if (trainer.pool != NULL) {
+
+			trainer.stride = ((network -> edges + 4) * sizeof(double) + NN_LINE - 1) / NN_LINE * NN_LINE / sizeof(double);
+
+			if ((share_size = trainer.stride * (trainer.cores + 1) * sizeof(double)) > trainer.share_size) {
+				free(trainer.share);
+				trainer.share_size = 0;
 
-			for (i = 0; i < core; i++) {
-				waitpid(children[i], status, 0);
-				if ((WIFEXITED(status) == 0) || WEXITSTATUS(status))
-					flag = true;
+				if ((trainer.share = aligned_alloc(NN_LINE, share_size)) == NULL)
+					goto fail;
+
+				trainer.share_size = share_size;
 			}
 
-			if (flag)
-				goto fail;
+			for (i = 0; i < trainer.cores; i++)
+				trainer.share[i * trainer.stride] = 0;
 
-			NNsync_to_core(network, post);
-			munmap(post, post_size);
-			post = NULL;
+			NNpool_run(trainer.pool, & NNtrain_task, &trainer);
 		} else {
-			if (NNtrain_core(network, 0, NULL, 0, param) == -1)
-				goto fail;
+			trainer.status = NNtrain_core(&trainer, 0);
 		}
 
-		flag = test_generalization(network, &general_cost, param);
+		if (trainer.status == -1)
+			goto fail;
+
+		flag = test_generalization(network, csr, &general_cost, param);
 
 		if ((general_cost < 0) && (backup != NULL))
 			goto fail;
 
+		if ((checkpoint != NULL) && (due = NNcheckpoint_due(checkpoint)))
+			if (NNcheckpoint_post(checkpoint, network) == -1)
+				goto fail;
+
 		if (param -> verbose)
 			printf("\nstage %d finished, cost : %lf\n\n", j++, general_cost);
 
 		switch (param -> callback(network, general_cost, param)) {
 			case NNAUTO:
+				if (csr != NULL)
+					NNfree_csr(csr), csr = NULL;
+
 				if (flag) {
 
 					if (backup != NULL)
@@ -155,6 +276,9 @@ struct NNetwork * NNtrain(struct NNetwork * network, struct NNparam * param) {
 			case NNCONTINUE :
 				flag = true;
 
+				if (csr != NULL)
+					NNfree_csr(csr), csr = NULL;
+
 				if (backup != NULL)
 					NNfree(backup);
 
@@ -172,63 +296,213 @@ struct NNetwork * NNtrain(struct NNetwork * network, struct NNparam * param) {
 			case NNTERMINATE :
 				goto done;
 		}
+
+		if (due && flag) {
+			state -> stage = j,
+			state -> freeze_steps = param -> freeze_steps,
+			state -> activ_index = param -> activ_index,
+			state -> tolerance = param -> tolerance,
+			state -> general_cost = general_cost,
+			state -> step_size = param -> step_size,
+			state -> freeze_hold = param -> freeze_hold,
+			state -> vanish_hold = param -> vanish_hold,
+			state -> reaction_hold = param -> reaction_hold;
+
+			if (NNcheckpoint_state(checkpoint, state, network, backup) == -1)
+				goto fail;
+		}
 	} while (flag);
 
 done:
+	if (csr != NULL)
+		NNfree_csr(csr);
+
+	NNtrainer_stop(&trainer);
+
+	if (checkpoint != NULL)
+		if ((NNcheckpoint_stop(checkpoint) == -1) && param -> verbose)
+			printf("\ncheckpoint failed : %s\n", strerror(errno));
+
 	if (backup != NULL)
 		NNfree(backup);
 
 	return network;
 
 fail:
+	if (csr != NULL)
+		NNfree_csr(csr);
+
+	NNtrainer_stop(&trainer);
+
+	if (checkpoint != NULL)
+		NNcheckpoint_stop(checkpoint);
+
 	if (backup != NULL)
 		NNfree(backup);
 
 	if (network != NULL)
 		NNfree(network);
 
-	if (post != NULL)
-		munmap(post, post_size);
-
 	return NULL;
 }
 
 
 /*
-	one stage training for a single core process
+	start the threads and the buffers kept by a training across its stages
 
-	network -- the neural network to train
-	post -- a sharing space for all core processes
-	param -- the user-defined parameters
+	trainer -- the trainer to start, zeroed
+	network -- the network to train first
+	param -- parameters uses in training the network
+
+	return 0 on success, -1 on failed (OOM or threads can not be created). NNtrainer_stop must be called either way
 
-	return 0 on success, -1 on fail. if single core used the trained network is stored in the address of original network, otherwise network data need to be collected from post
+	note: with param -> core > 0 a pool of that many threads trains every stage, the caller being core 0. param -> core is read here only, the pool lives until the training ends.
 */
 
-int NNtrain_core(struct NNetwork * network, unsigned int order, volatile double * post, pid_t ppid, struct NNparam * param) {
+int NNtrainer_start(struct NNtrainer * trainer, const struct NNetwork * network, struct NNparam * param) {
 
-	unsigned int inputs = network -> inputs, outputs = network -> outputs, v = network -> vertices, e = network -> edges;
-	int core = param -> core, freeze_steps = param -> freeze_steps, verbose = param -> verbose, frozen = 0, tolerance = param -> tolerance, tcount = 0, shrink = 0, brim = 0, flag = 0;
-	size_t train_size = param -> train_size;
-	double step_size = param -> step_size, freeze_hold = param -> freeze_hold, vanish_hold = param -> vanish_hold, cost, last = 1.0/0.0, value, nuance,
-	(* train_set)[inputs + outputs] = (double (*)[inputs + outputs])param -> train_set,
-	outs[outputs], expects[outputs], derivatives[outputs], * gradient = NULL;
+	trainer -> param = param,
+	trainer -> cores = (param -> core > 0) ? param -> core : 1;
 
-	volatile double (* share)[core] = (volatile double (*)[core])post;
-	if (share != NULL)
-		share[0][order] = 0;
+	if ((trainer -> block = aligned_alloc(NN_LINE, trainer -> cores * sizeof(struct NNblock))) == NULL)
+		return -1;
+
+	if (param -> core > 0) {
+		if ((trainer -> replica = calloc(trainer -> cores, sizeof(struct NNreplica))) == NULL)
+			return -1;
+
+		if ((trainer -> pool = NNpool_create(trainer -> cores)) == NULL)
+			return -1;
+	}
+
+	if (param -> source != NULL)
+		if ((trainer -> stream = NNstream_start(param -> source, param -> source_context, param -> source_batch, network -> inputs + network -> outputs, trainer -> cores)) == NULL)
+			return -1;
+
+	return 0;
+}
+
+
+/*
+	stop the threads and free the buffers of a trainer
+
+	trainer -- the trainer, as left by NNtrainer_start
+*/
+
+void NNtrainer_stop(struct NNtrainer * trainer) {
+
+	unsigned int i;
+
+	if (trainer -> stream != NULL)
+		NNstream_stop(trainer -> stream);
+
+	if (trainer -> pool != NULL)
+		NNpool_free(trainer -> pool);
+
+	if (trainer -> replica != NULL) {
+		for (i = 0; i < trainer -> cores; i++) {
+			if (trainer -> replica[i].csr != NULL)
+				NNfree_csr(trainer -> replica[i].csr);
+
+			free(trainer -> replica[i].network);
+		}
+
+		free(trainer -> replica);
+	}
+
+	free(trainer -> block);
+	free(trainer -> share);
+	free(trainer -> index);
+
+	memset(trainer, 0, sizeof(struct NNtrainer));
+	return;
+}
 
-	if ((gradient = malloc(e * sizeof(double))) == NULL)
+
+/*
+	the task of one thread training a stage
+
+	arg -- the trainer
+	id -- the core of the thread
+	threads -- the number of cores
+*/
+
+void NNtrain_task(void * arg, unsigned int id, unsigned int threads) {
+
+	struct NNtrainer * trainer = arg;
+	int status = NNtrain_core(trainer, id);
+
+	(void)threads;
+
+	if (id == 0)
+		trainer -> status = status;
+
+	return;
+}
+
+
+/*
+	one stage training for a single core
+
+	trainer -- the network, the parameters and the buffers of the training
+	order -- the index of the core, 0 trains trainer -> network itself
+
+	return 0 on success, -1 on fail (every core fails together). The trained network is stored in the address of original network
+
+	note: the other cores train a replica of the network and apply the same updates to it, so they all agree on the weights after each round. Each core publishes its failure flag, cost, part of the norm, the count of samples it propagated back and its nuances scaled by that count in its own row of trainer -> share, rows start on a cache line so no two cores write the same line. The reduced nuance is the sum of the rows over the sum of the counts, the mean over every sample of the round as with a single core however the samples were split, a core that got none adds nothing. From NN_SCATTER_MIN edges on, the nuances are reduced and scattered: every core sums the rows over its own slice of the edges into the last row, then all cores apply the whole reduced gradient, otherwise every core sums all the rows itself and saves a barrier.
+*/
+
+int NNtrain_core(struct NNtrainer * trainer, unsigned int order) {
+
+	struct NNetwork * network = trainer -> network;
+	struct NNcsr * csr = trainer -> csr;
+	struct NNparam * param = trainer -> param;
+	struct NNstream * stream = trainer -> stream;
+	unsigned int inputs = network -> inputs, outputs = network -> outputs, e = network -> edges;
+	struct NNblock * block = trainer -> block + order;
+	int core = trainer -> cores, epochs = param -> epochs, freeze_steps = param -> freeze_steps, verbose = param -> verbose, frozen = 0, tolerance = param -> tolerance, tcount = 0, shrink = 0, brim = 0, flag = 0, status = 0;
+	double step_size = param -> step_size, freeze_hold = param -> freeze_hold, vanish_hold = param -> vanish_hold, cost, last = 1.0/0.0, value, nuance, taken, epoch_cost = 0, epoch_nuance = 0,
+	outs[outputs], expects[outputs], derivatives[outputs], buffer[inputs + outputs], * row, * gradient = NULL;
+	void * workspace = NULL;
+	struct NNiter * iter = NULL;
+	size_t workspace_size;
+	unsigned int turn;
+	bool failed = false;
+
+	double (* share)[trainer -> stride] = (trainer -> pool != NULL) ? (double (*)[trainer -> stride])trainer -> share : NULL, * reduced = NULL;
+	size_t slice = 0, low = 0, high = 0;
+
+	if ((order > 0) && ((network = NNtrain_replica(trainer, order, &csr)) == NULL)) {
+		failed = true;
+	} else if ((gradient = malloc(e * sizeof(double))) == NULL) {
+		failed = true;
+	} else if (csr == NULL) {
+		workspace_size = NNiter_workspace_size(network);
+
+		if (((workspace = malloc(workspace_size)) == NULL) || ((iter = NNiter_init(network, NN_FORWARD, workspace, workspace_size)) == NULL))
+			failed = true;
+	}
+
+	if (NNtrain_sync(trainer, order, failed) == -1)
 		goto fail;
 
+	if (share != NULL)
+		NNpool_barrier(trainer -> pool);
+
 	NNcost eval_cost = param -> eval_cost;
 
 	struct NNvertex * vertex, * vertices = (void *)network -> contents;
-	struct NNedge * edges = (void *)(vertices + v);
+	struct NNedge * edges = (void *)(vertices + network -> vertices);
 
-	if (core <= 0)
-		core = 1;
+	size_t batch = (stream == NULL) ? param -> batch_size : 0, start = 0, length = 0, i, j, k = 1, pos, end;
+	int epoch = 0;
 
-	size_t batch_per_core = train_size / core, i, j, k = 1, pos = order;
+	if ((share != NULL) && (core > 1) && (e >= NN_SCATTER_MIN)) {
+		reduced = share[core],
+		slice = ((e + core - 1) / core * sizeof(double) + NN_LINE - 1) / NN_LINE * NN_LINE / sizeof(double),
+		low = (order * slice < e) ? order * slice : e,
+		high = (low + slice < e) ? low + slice : e;
+	}
 
 	if (freeze_hold < 0)
 		freeze_hold = vanish_hold;
@@ -237,16 +511,46 @@ int NNtrain_core(struct NNetwork * network, unsigned int order, volatile double
 
 		NNclear_count(network);
 
-		cost = 0, nuance = 0, pos = order;
+		if (csr != NULL)
+			NNcsr_load(csr, network);
 
-		for (i = 0; i < batch_per_core; i++) {
+		cost = 0, nuance = 0, taken = 0, status = 0, turn = 0, pos = 0, end = 0;
 
-			if (NNpropagate(network, train_set[pos], NN_FORWARD, false) == -1)
-				goto fail;
+		if (batch > 0) {
+
+			if (start == 0) {
+				if (order == 0)
+					NNshuffle(trainer -> index, trainer -> samples, &trainer -> random);
+
+				if (share != NULL)
+					NNpool_barrier(trainer -> pool);
+			}
+
+			length = (trainer -> samples - start < batch) ? trainer -> samples - start : batch;
+			pos = start + length * order / core,
+			end = start + length * (order + 1) / core;
+		} else {
+			atomic_store_explicit(&block -> next, block -> begin, memory_order_relaxed);
+		}
+
+		while (true) {
+
+			if (stream != NULL) {
+				if ((status = NNstream_row(stream, order, &row)) <= 0)
+					break;
+			} else {
+				if ((pos == end) && ((batch > 0) || !NNtrain_chunk(trainer, order, &turn, &pos, &end)))
+					break;
+
+				row = NNrow(param -> train_set, param -> train_type, inputs + outputs, (batch > 0) ? trainer -> index[pos++] : pos++, buffer);
+			}
+
+			if ((status = NNpropagate(network, csr, iter, row, NN_FORWARD, false)) == -1)
+				break;
 
 			vertex = vertices + inputs + 1;
 			for (j = 0; j < outputs; j++)
-				outs[j] = vertex[j].value, expects[j] = train_set[pos][inputs + j];
+				outs[j] = vertex[j].value, expects[j] = row[inputs + j];
 
 			if (flag) {
 
@@ -255,35 +559,37 @@ int NNtrain_core(struct NNetwork * network, unsigned int order, volatile double
 
 				cost += eval_cost(outputs, outs, expects, derivatives);
 
-				if (NNpropagate(network, derivatives, NN_BACKWARD, false) == -1)
-					goto fail;
-			}
+				if ((status = NNpropagate(network, csr, iter, derivatives, NN_BACKWARD, false)) == -1)
+					break;
 
-			pos += core;
+				taken++;
+			}
 		}
 
+		if (csr != NULL)
+			NNcsr_store(csr, network);
+
 		if (share != NULL) {
 
-			share[1][order] = cost;
+			share[order][1] = cost,
+			share[order][3] = taken;
 
 			for (i = 0; i < e; i++)
-				share[i + 2][order] = edges[i].nuance;
-
-			cost = 0;
+				share[order][i + 4] = (taken > 0) ? edges[i].nuance * taken : 0;
+		}
 
-			for (i = 0; i < (size_t)core; i++) {
+		if (NNtrain_sync(trainer, order, status == -1) == -1)
+			goto fail;
 
-				if (i == order)
-					share[0][order] = 1;
+		if (share != NULL) {
 
-				while (1 != (int)(share[0][i] + 0.5))
-					if (-1 == (int)(share[0][i] - 0.5))
-						goto fail;
+			cost = 0, taken = 0;
 
-				cost += share[1][i];
-			}
+			for (i = 0; i < (size_t)core; i++)
+				cost += share[i][1],
+				taken += share[i][3];
 
-			if (last <= cost) {
+			if ((batch == 0) && (last <= cost)) {
 				
 				for (i = 0; i < e; i++) {
 					gradient[i] /= 2;
@@ -294,12 +600,7 @@ int NNtrain_core(struct NNetwork * network, unsigned int order, volatile double
 				}
 
 				if (nuance > vanish_hold * vanish_hold) {
-
-					for (i = 0; i < (size_t)core; i++) {
-						if (i == order)
-							share[0][order] = 0;
-						while (0 != (int)(share[0][i] + 0.5));
-					}
+					NNpool_barrier(trainer -> pool);
 
 					shrink++, k++, flag = 1;
 					continue;
@@ -319,31 +620,58 @@ int NNtrain_core(struct NNetwork * network, unsigned int order, volatile double
 
 			nuance = 0, shrink = 0, flag = 0;
 
-			for (i = 0; i < e; i++) {
-				value = 0;
-				for (j = 0; j < (size_t)core; j++)
-					value += share[i + 2][j];
+			if (reduced != NULL) {
 
-				value /= core;
+				for (i = low; i < high; i++) {
+					value = 0;
+					for (j = 0; j < (size_t)core; j++)
+						value += share[j][i + 4];
 
-				nuance += value * value,
-				gradient[i] = value * step_size;
-				edges[i].weight -= gradient[i],
-				edges[i].nuance = 0,
-				edges[i].value = edges[i].weight;
+					if (taken > 0)
+						value /= taken;
+
+					nuance += value * value,
+					reduced[i] = value * step_size;
+				}
+
+				share[order][2] = nuance;
+
+				NNpool_barrier(trainer -> pool);
+
+				for (nuance = 0, j = 0; j < (size_t)core; j++)
+					nuance += share[j][2];
+
+				for (i = 0; i < e; i++) {
+					gradient[i] = reduced[i];
+					edges[i].weight -= gradient[i],
+					edges[i].nuance = 0,
+					edges[i].value = edges[i].weight;
+				}
+			} else {
+
+				for (i = 0; i < e; i++) {
+					value = 0;
+					for (j = 0; j < (size_t)core; j++)
+						value += share[j][i + 4];
+
+					if (taken > 0)
+						value /= taken;
+
+					nuance += value * value,
+					gradient[i] = value * step_size;
+					edges[i].weight -= gradient[i],
+					edges[i].nuance = 0,
+					edges[i].value = edges[i].weight;
+				}
 			}
 
 			last = cost;
 
-			for (i = 0; i < (size_t)core; i++) {
-				if (i == order)
-					share[0][order] = 0;
-				while (0 != (int)(share[0][i] + 0.5));
-			}
+			NNpool_barrier(trainer -> pool);
 
 		} else {
 
-			if (last <= cost) {
+			if ((batch == 0) && (last <= cost)) {
 
 				for (i = 0; i < e; i++) {
 					gradient[i] /= 2;
@@ -383,58 +711,152 @@ int NNtrain_core(struct NNetwork * network, unsigned int order, volatile double
 			last = cost;
 		}
 
-		if (verbose && (!order))
-			printf("Round %zu, cost: %lf\n", k++, cost);
+		if (batch > 0) {
+			epoch_cost += cost,
+			epoch_nuance += nuance;
+
+			if ((start += length) < trainer -> samples)
+				continue;
 
-#ifndef __linux__
-		if ((share != NULL) && (!order) && (getppid() != ppid)) {
-			share[0][order] = -1;
-			_exit(1);
+			cost = epoch_cost, nuance = epoch_nuance,
+			epoch_cost = 0, epoch_nuance = 0, start = 0, epoch++;
 		}
-#endif
+
+		if (verbose && (!order))
+			printf("%s %zu, cost: %lf\n", (batch > 0) ? "Epoch" : "Round", k++, cost);
+
 		if (nuance <= freeze_hold || cost < vanish_hold) {
 			frozen++;
 		} else {
 			frozen = 0;
 		}
-	}
 
-	if (!order)
-		if (post != NULL)
-			for (i = 0; i < e; i++)
-				post[i] = edges[i].weight;
+		if ((batch > 0) && (epochs > 0) && (epoch >= epochs))
+			break;
+	}
 
 	free(gradient);
+	free(workspace);
 
 	return 0;
 
 fail:
-	if (share != NULL)
-		share[0][order] = -1;
-
 	if (gradient != NULL)
 		free(gradient);
 
+	if (workspace != NULL)
+		free(workspace);
+
 	return -1;
 }
 
 
 /*
-	sync the main process' network with the one trained in many cores
+	copy the network of a stage into the replica of a core
+
+	trainer -- the trainer
+	order -- the index of the core, above 0
+	csr -- where to store the CSR of the replica, NULL if the training runs on the linked layout
 
-	network -- the network to recollect
-	post -- the shared space where data of trained network is stored
+	return the replica on success, NULL on failed (OOM)
+
+	note: the memory of a replica is kept from stage to stage and only grows, the copy is made by the core itself so its pages are local to the core. The replica has no cached schedule, the iterator of the core builds a private one.
 */
 
-void NNsync_to_core(struct NNetwork * network, volatile double * post) {
+struct NNetwork * NNtrain_replica(struct NNtrainer * trainer, unsigned int order, struct NNcsr ** csr) {
 
-	struct NNedge * edges = (void *)(((struct NNvertex *)(void *)(network -> contents)) + network -> vertices);
-	unsigned int e = network -> edges, i;
+	struct NNreplica * replica = trainer -> replica + order;
+	size_t size = NNsize(trainer -> network);
 
-	for (i = 0; i < e; i++)
-		edges[i].weight = post[i];
+	if (replica -> csr != NULL)
+		NNfree_csr(replica -> csr), replica -> csr = NULL;
 
-	return;
+	if (replica -> size < size) {
+		free(replica -> network);
+		replica -> size = 0;
+
+		if ((replica -> network = malloc(size)) == NULL)
+			return NULL;
+
+		replica -> size = size;
+	}
+
+	memcpy(replica -> network, trainer -> network, size);
+	replica -> network -> schedule = NULL;
+
+	if (trainer -> csr != NULL)
+		if ((replica -> csr = NNget_csr(replica -> network)) == NULL)
+			return NULL;
+
+	* csr = replica -> csr;
+
+	return replica -> network;
+}
+
+
+/*
+	take the next chunk of the training set for a core
+
+	trainer -- the trainer
+	order -- the index of the core
+	turn -- the blocks the core emptied this round, 0 at the start of a round
+	pos -- where to store the first sample of the chunk
+	end -- where to store the end of the chunk
+
+	return true if a chunk is taken, false if every block is empty
+
+	note: the training set is cut in chunks of NN_CHUNK samples and each core owns a contiguous block of them, so it walks its own part of the memory. A core that emptied its block takes the chunks left in the blocks of the next cores, so every sample is trained on once per round and a slow core is helped by the fast ones. Which core trains a sample (and so the order the nuances are summed in) depends on the timing when core > 1.
+*/
+
+bool NNtrain_chunk(struct NNtrainer * trainer, unsigned int order, unsigned int * turn, size_t * pos, size_t * end) {
+
+	struct NNblock * block;
+	size_t chunk;
+
+	for (; * turn < trainer -> cores; (* turn)++) {
+		block = trainer -> block + (order + * turn) % trainer -> cores;
+
+		if ((chunk = atomic_fetch_add_explicit(&block -> next, 1, memory_order_relaxed)) < block -> end) {
+			* pos = chunk * NN_CHUNK,
+			* end = (* pos + NN_CHUNK < trainer -> samples) ? * pos + NN_CHUNK : trainer -> samples;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+	wait for every core to finish its part of a round
+
+	trainer -- the trainer
+	order -- the index of the core
+	failed -- true if the core failed
+
+	return 0 on success, -1 if any core failed
+
+	note: a core failing still comes to the barrier so the others do not wait for it, and all of them see the failure and leave together. The flags are only written by a failing core, so another barrier must come between two syncs, or a fast core could fail the next sync while a slow one still reads this one.
+*/
+
+int NNtrain_sync(struct NNtrainer * trainer, unsigned int order, bool failed) {
+
+	unsigned int i;
+
+	if (trainer -> pool == NULL)
+		return failed ? -1 : 0;
+
+	if (failed)
+		trainer -> share[order * trainer -> stride] = -1;
+
+	NNpool_barrier(trainer -> pool);
+
+	for (i = 0; i < trainer -> cores; i++)
+		if (trainer -> share[i * trainer -> stride] < 0)
+			return -1;
+
+	return 0;
 }
 
 
@@ -448,33 +870,57 @@ void NNsync_to_core(struct NNetwork * network, volatile double * post) {
 	return true if test passed, false if not. If failed, general_cost will be set to a negative value while returns true
 */
 
-bool test_generalization(struct NNetwork * network, double * general_cost, struct NNparam * param) {
+bool test_generalization(struct NNetwork * network, struct NNcsr * csr, double * general_cost, struct NNparam * param) {
 
 	unsigned int inputs = network -> inputs, outputs = network -> outputs, j;
 	size_t test_size = param -> test_size, i;
-	double (* test_set)[inputs + outputs] = (double (*)[inputs + outputs])param -> test_set, cost = 0.0, outs[outputs], expects[outputs], derivatives[outputs];
+	double cost = 0.0, outs[outputs], expects[outputs], derivatives[outputs], buffer[inputs + outputs], * row;
 
 	NNcost eval_cost = param -> eval_cost;
 
 	struct NNvertex * vertices = (void *)network -> contents;
 	struct NNvertex * vertex = vertices + inputs + 1;
 
+	void * workspace = NULL;
+	struct NNiter * iter = NULL;
+	size_t workspace_size;
+
+	if (csr == NULL) {
+		workspace_size = NNiter_workspace_size(network);
+
+		if ((workspace = malloc(workspace_size)) == NULL)
+			goto fail;
+
+		if ((iter = NNiter_init(network, NN_FORWARD, workspace, workspace_size)) == NULL)
+			goto fail;
+	}
+
 	NNclear_count(network);
 
+	if (csr != NULL)
+		NNcsr_load(csr, network);
+
 	for (i = 0; i < test_size; i++) {
 
-		if (NNpropagate(network, test_set[i], NN_FORWARD, true) == -1)
+		row = NNrow(param -> test_set, param -> test_type, inputs + outputs, i, buffer);
+
+		if (NNpropagate(network, csr, iter, row, NN_FORWARD, true) == -1)
 			goto fail;
 
 		for (j = 0; j < outputs; j++)
-			outs[j] = vertex[j].value, expects[j] = test_set[i][inputs + j];
+			outs[j] = vertex[j].value, expects[j] = row[inputs + j];
 
 		cost += eval_cost(outputs, outs, expects, derivatives);
 
-		if (NNpropagate(network, derivatives, NN_BACKWARD, true) == -1)
+		if (NNpropagate(network, csr, iter, derivatives, NN_BACKWARD, true) == -1)
 			goto fail;	
 	}
 
+	if (csr != NULL)
+		NNcsr_store(csr, network);
+
+	free(workspace);
+
 	if (* general_cost < 0) {
 		* general_cost = cost;
 		return true;		
@@ -489,6 +935,9 @@ bool test_generalization(struct NNetwork * network, double * general_cost, struc
 	return true;
 
 fail:
+	if (workspace != NULL)
+		free(workspace);
+
 	*general_cost = -3.0;
 	return true;
 }
@@ -521,6 +970,8 @@ struct NNetwork * NNevolve(struct NNetwork * old, struct NNparam * param) {
 		}
 	}
 
+	NNinvalidate_schedule(network);
+
 	if ((network = NNtruncate(network)) == NULL)
 		goto fail;
 
@@ -540,6 +991,35 @@ fail:
 }
 
 
+/*
+	get a sample of a training or test set
+
+	set -- the samples, double[size][width] or float[size][width] cast as in struct NNparam
+	type -- NN_DOUBLE or NN_FLOAT, the element type of set
+	width -- the inputs plus the outputs of the network
+	index -- the sample to get
+	buffer -- where to widen a float sample, double[width]
+
+	return the sample as doubles, inside set for NN_DOUBLE, in buffer for NN_FLOAT
+*/
+
+double * NNrow(double ** set, int type, unsigned int width, size_t index, double * buffer) {
+
+	const float * sample;
+	unsigned int i;
+
+	if (type != NN_FLOAT)
+		return (double *)set + index * width;
+
+	sample = (const float *)(void *)set + index * width;
+
+	for (i = 0; i < width; i++)
+		buffer[i] = sample[i];
+
+	return buffer;
+}
+
+
 /*
 	clear the count field of vertices and edges in network
 
@@ -585,6 +1065,8 @@ void NNrelax(struct NNetwork * network, double vanish_hold) {
 	propagate the neural network
 
 	network -- the neural network to propagate
+	csr -- the compact adjacency of the network to run on, NULL for the linked edge lists
+	iter -- the iterator of the network from NNiter_init, used and rewound if csr is NULL
 	init -- the initialization values for propagation (input for forward propagate, derivatives for backward)
 	direction -- forward or backward propagation. suggest to use NN_FORWARD or NN_BACKWARD
 	test -- whether the propagation is running for test_generalization
@@ -594,10 +1076,13 @@ void NNrelax(struct NNetwork * network, double vanish_hold) {
 	note: this function may be redundant
 */
 
-int NNpropagate(struct NNetwork * network, double * init, bool direction, bool test) {
+int NNpropagate(struct NNetwork * network, struct NNcsr * csr, struct NNiter * iter, double * init, bool direction, bool test) {
+	if (csr != NULL)
+		return (direction == NN_BACKWARD) ? backward_csr(network, csr, init, test) : forward_csr(network, csr, init);
+	NNiter_reset(iter, direction);
 	if (direction == NN_BACKWARD)
-		return backward_prop(network, init, test);
-	return forward_prop(network, init);
+		return backward_prop(network, iter, init, test);
+	return forward_prop(network, iter, init);
 }
 
 
@@ -605,22 +1090,19 @@ int NNpropagate(struct NNetwork * network, double * init, bool direction, bool t
 	propagate the neural network in forward direction
 
 	network -- the neural network to propagate
+	iter -- the forward iterator of the neural network, rewound
 	init -- the array of input values
 
 	return 0 on success, -1 on failed
 */
 
-int forward_prop(struct NNetwork * network, double * init) {
-
-	struct NNiter * iter = NULL;
-	if ((iter = NNget_iter(network, NN_FORWARD)) == NULL)
-		return -1;
+int forward_prop(struct NNetwork * network, struct NNiter * iter, double * init) {
 
 	unsigned int i = 0;
 	int flag;
 	double value;
-	struct NNvertex * vertex;
-	struct NNedge * edge;
+	struct NNvertex * vertices = (void *)network -> contents, * vertex;
+	struct NNedge * edges = (void *)(vertices + network -> vertices), * edge;
 	void * buf;
 
 	while ((flag = NNiterate(&iter, &buf)) >= 0) {
@@ -631,31 +1113,27 @@ int forward_prop(struct NNetwork * network, double * init) {
 				vertex = buf;
 				if (vertex -> layer_index == 0) {
 					vertex -> value = init[i++];
+					vertex -> output = activ_table[vertex -> activ_index](vertex -> value);
 					break;
 				}
 
-				edge = vertex -> edges[NN_BACKWARD];
+				edge = edges + vertex -> edges[NN_BACKWARD];
 				do {
 					value += edge -> value;
-				} while ((edge = edge -> next[NN_BACKWARD]) != NULL);
+				} while ((edge = NN_EDGE(edges, edge -> next[NN_BACKWARD])) != NULL);
 
 				vertex -> value = value;
+				vertex -> output = activ_table[vertex -> activ_index](value);
+				vertex -> d_output = d_activ_table[vertex -> activ_index](value);
 				break;
 
 			case NNITER_IS_EDGE :
 				edge = buf;
-				vertex = edge -> vertices[NN_BACKWARD];
-				edge -> value = (edge -> weight) * vertex -> activate(vertex -> value);
+				edge -> value = (edge -> weight) * vertices[edge -> vertices[NN_BACKWARD]].output;
 				break;
 		}
 	}
 
-	if (flag == NNITER_IS_ERROR) {
-		NNfree_iter(iter);
-		return -1;
-	}
-
-	NNfree_iter(iter);
 	return 0;
 }
 
@@ -664,22 +1142,19 @@ int forward_prop(struct NNetwork * network, double * init) {
 	propagate the neural network in backward direction
 
 	network -- the neural network to propagate
+	iter -- the backward iterator of the neural network, rewound
 	init -- the array of output derivatives
 
 	return 0 on success, -1 on failed
 */
 
-int backward_prop(struct NNetwork * network, double * init, bool test) {//struct NNedge * edges = (void *)network -> contents + network -> vertices * sizeof(struct NNvertex);
-
-	struct NNiter * iter = NULL;
-	if ((iter = NNget_iter(network, NN_BACKWARD)) == NULL)
-		return -1;
+int backward_prop(struct NNetwork * network, struct NNiter * iter, double * init, bool test) {
 
 	unsigned int i = 0;
 	int flag;
 	double value, count;
-	struct NNvertex * vertex;
-	struct NNedge * edge;
+	struct NNvertex * vertices = (void *)network -> contents, * vertex;
+	struct NNedge * edges = (void *)(vertices + network -> vertices), * edge;
 	void * buf;
 
 	while ((flag = NNiterate(&iter, &buf)) >= 0) {
@@ -693,12 +1168,12 @@ int backward_prop(struct NNetwork * network, double * init, bool test) {//struct
 					break;
 				}
 
-				edge = vertex -> edges[NN_FORWARD];
+				edge = edges + vertex -> edges[NN_FORWARD];
 				do {
-					value += edge -> weight * edge -> vertices[NN_FORWARD] -> derivative;
-				} while ((edge = edge -> next[NN_FORWARD]) != NULL);
+					value += edge -> weight * vertices[edge -> vertices[NN_FORWARD]].derivative;
+				} while ((edge = NN_EDGE(edges, edge -> next[NN_FORWARD])) != NULL);
 
-				vertex -> derivative = (value *= vertex -> d_activate(vertex -> value));
+				vertex -> derivative = (value *= vertex -> d_output);
 
 				if (test)
 					value *= value;
@@ -710,8 +1185,8 @@ int backward_prop(struct NNetwork * network, double * init, bool test) {//struct
 
 			case NNITER_IS_EDGE :
 				edge = buf;
-				vertex = edge -> vertices[NN_BACKWARD];
-				edge -> derivative = (value = vertex -> activate(vertex -> value) * (edge -> vertices[NN_FORWARD] -> derivative));
+				vertex = vertices + edge -> vertices[NN_BACKWARD];
+				edge -> derivative = (value = vertex -> output * vertices[edge -> vertices[NN_FORWARD]].derivative);
 
 				if (test)
 					value *= value;
@@ -723,12 +1198,112 @@ int backward_prop(struct NNetwork * network, double * init, bool test) {//struct
 		}
 	}
 
-	if (flag == NNITER_IS_ERROR) {
-		NNfree_iter(iter);
-		return -1;
-	}
 //if (NNdebug) printf("back: %d\n", edges[6].flag);
-	NNfree_iter(iter);
+	return 0;
+}
+
+
+/*
+	propagate the neural network in forward direction over its compact adjacency
+
+	network -- the neural network to propagate
+	csr -- the adjacency of the network, loaded with its current weights
+	init -- the array of input values
+
+	return 0 on success
+
+	note: same as forward_prop, but the inputs are bound in index order, every vertex is visited exactly once in topological order and the sums are gathered from contiguous rows. The vertex state is kept in csr (see NNcsr_store), only the values of the outputs are written to the network. Edge values are not stored.
+*/
+
+int forward_csr(struct NNetwork * network, struct NNcsr * csr, double * init) {
+
+	unsigned int inputs = csr -> inputs, outputs = csr -> outputs, s = csr -> steps, i, j, k;
+	double value, * values = csr -> value, * outs = csr -> output, * d_outs = csr -> d_output;
+
+	const unsigned int * start = csr -> in_start, * source = csr -> in_source;
+	const double * weight = csr -> in_weight;
+	struct NNvertex * vertices = (void *)network -> contents;
+
+	for (i = 1; i <= inputs; i++)
+		values[i] = init[i - 1],
+		outs[i] = csr -> activate[i](values[i]);
+
+	for (i = 0; i < s; i++) {
+		j = csr -> order[i];
+
+		for (k = start[j], value = 0; k < start[j + 1]; k++)
+			value += weight[k] * outs[source[k]];
+
+		values[j] = value,
+		outs[j] = csr -> activate[j](value),
+		d_outs[j] = csr -> d_activate[j](value);
+	}
+
+	for (i = inputs + 1; i <= inputs + outputs; i++)
+		vertices[i].value = values[i];
+
+	return 0;
+}
+
+
+/*
+	propagate the neural network in backward direction over its compact adjacency
+
+	network -- the neural network to propagate
+	csr -- the adjacency of the network, loaded with its current weights and edge statistics
+	init -- the array of output derivatives
+	test -- whether the propagation is running for test_generalization
+
+	return 0 on success
+
+	note: same as backward_prop, the vertex and edge statistics are gathered in csr (see NNcsr_store) and the derivatives of single edges are not stored. Hidden vertices without outgoing edges are not reached, as with the iterator.
+*/
+
+int backward_csr(struct NNetwork * network, struct NNcsr * csr, double * init, bool test) {
+
+	unsigned int inputs = csr -> inputs, outputs = csr -> outputs, s = csr -> steps, i, j, k;
+	double value, count, derivative, * nuance = csr -> nuance, * counts = csr -> count, * derivatives = csr -> derivative;
+
+	const unsigned int * start = csr -> out_start, * target = csr -> out_target, * in_start = csr -> in_start, * source = csr -> in_source;
+	const double * weight = csr -> out_weight, * outs = csr -> output;
+
+	(void)network;
+
+	for (i = 0; i < outputs; i++)
+		derivatives[inputs + 1 + i] = init[i];
+
+	for (i = s; i-- > 0;) {
+		j = csr -> order[i];
+
+		if (j > inputs + outputs) {
+			if (start[j] == start[j + 1])
+				continue;
+
+			for (k = start[j], value = 0; k < start[j + 1]; k++)
+				value += weight[k] * derivatives[target[k]];
+
+			derivatives[j] = (value *= csr -> d_output[j]);
+
+			if (test)
+				value *= value;
+
+			count = csr -> vertex_count[j];
+			csr -> vertex_nuance[j] = csr -> vertex_nuance[j] * (count / (count + 1)) + value / (count + 1);
+			csr -> vertex_count[j] = count + 1;
+		}
+
+		for (k = in_start[j], derivative = derivatives[j]; k < in_start[j + 1]; k++) {
+			value = outs[source[k]] * derivative;
+
+			if (test)
+				value *= value;
+
+			count = counts[k];
+			nuance[k] = nuance[k] * (count / (count + 1)) + value / (count + 1);
+			counts[k] = count + 1;
+		}
+	}
+
 	return 0;
 }
 
@@ -745,7 +1320,7 @@ int backward_prop(struct NNetwork * network, double * init, bool test) {//struct
 
 struct NNetwork * NNtruncate(struct NNetwork * network) {
 
-	struct NNiter * iter = NULL;
+	struct NNiter workspace, * iter = NULL;
 	struct NNetwork * new = NULL;
 
 	unsigned int inputs = network -> inputs, outputs = network -> outputs, v = network -> vertices, e = network -> edges, i, j;
@@ -757,107 +1332,102 @@ struct NNetwork * NNtruncate(struct NNetwork * network) {
 		goto fail;
 
 	new -> inputs = inputs,
-	new -> outputs = outputs;
+	new -> outputs = outputs,
+	new -> schedule = NULL;
 
 	struct NNvertex * new_vertices = (void *)new -> contents, * vertex;
 
+	for (i = 0; i < v; i++)
+		new_vertices[i].value = 0,
+		new_vertices[i].output = 0,
+		new_vertices[i].d_output = 0,
+		new_vertices[i].derivative = 0,
+		new_vertices[i].nuance = 0,
+		new_vertices[i].count = 0,
+		new_vertices[i].edges[NN_FORWARD] = NN_NIL,
+		new_vertices[i].edges[NN_BACKWARD] = NN_NIL,
+		new_vertices[i].map = NN_NIL;
+
 	new_vertices[0].layer_index = 0,
 	new_vertices[0].activ_index = _identity,
-	new_vertices[0].activate = activ_table[_identity],
-	new_vertices[0].d_activate = d_activ_table[_identity],
-	new_vertices[0].value = 1;
-	vertices[0].map = & new_vertices[0];
+	new_vertices[0].value = 1,
+	new_vertices[0].output = 1;
+	vertices[0].map = 0;
+
+	for (i = 1; i <= inputs + outputs; i++) {
+		vertex = vertices + i;
+		new_vertices[i].layer_index = vertex -> layer_index,
+		new_vertices[i].activ_index = _identity,
+		new_vertices[i].nuance = vertex -> nuance;
+		vertex -> map = i;
+	}
 
-	i = 1, j = inputs + outputs + 1;
+	j = inputs + outputs + 1;
 
-	if ((iter = NNget_iter(network, NN_FORWARD)) == NULL)
+	if ((NNget_schedule(network) == NULL) || ((iter = NNiter_init(network, NN_FORWARD, &workspace, sizeof(workspace))) == NULL))
 		goto fail;
 
 	int flag;
 	while ((flag = NNiterate(&iter, &vertex)) >= 0) {
 
 		if (flag == NNITER_IS_VERTEX) {
-			if (vertex -> layer_index == 0 || vertex -> layer_index == (unsigned int)-1) {
-				new_vertices[i].map = NULL;
-				new_vertices[i].layer_index = vertex -> layer_index,
-				new_vertices[i].activ_index = _identity,
-				new_vertices[i].activate = activ_table[_identity],
-				new_vertices[i].d_activate = d_activ_table[_identity],
-				new_vertices[i].nuance = vertex -> nuance;
-				vertex -> map = & new_vertices[i];
-				i++;
-			} else {
-				new_vertices[j].map = NULL;
+			if (vertex -> layer_index != 0 && vertex -> layer_index != (unsigned int)-1) {
 				new_vertices[j].layer_index = vertex -> layer_index,
 				new_vertices[j].activ_index = vertex -> activ_index,
-				new_vertices[j].activate = vertex -> activate,
-				new_vertices[j].d_activate = vertex -> d_activate,
 				new_vertices[j].nuance = vertex -> nuance;
-				vertex -> map = & new_vertices[j];
+				vertex -> map = j;
 				j++;
 			}
 		}
 	}
 
-	if (flag == NNITER_IS_ERROR)
-		goto fail;
-
-	NNfree_iter(iter);
-
 	struct NNedge * new_edges = (void *)(& new_vertices[j]);
 	new -> vertices = j;
 	i = 0;
 
-	if ((iter = NNget_iter(network, NN_BACKWARD)) == NULL)
-		goto fail;
+	NNiter_reset(iter, NN_BACKWARD);
 
 	while ((flag = NNiterate(&iter, &edge)) >= 0) {
 
 		if (flag == NNITER_IS_EDGE) {
-			if ((edge -> vertices[NN_FORWARD] -> map == NULL) || (edge -> vertices[NN_BACKWARD] -> map == NULL))
+			if ((vertices[edge -> vertices[NN_FORWARD]].map == NN_NIL) || (vertices[edge -> vertices[NN_BACKWARD]].map == NN_NIL))
 				continue;
 
 			new_edges[i].flag = 0,
 			new_edges[i].weight = edge -> weight,
+			new_edges[i].value = 0,
+			new_edges[i].derivative = 0,
 			new_edges[i].nuance = edge -> nuance,
-			new_edges[i].vertices[NN_FORWARD] = edge -> vertices[NN_FORWARD] -> map,
-			new_edges[i].vertices[NN_BACKWARD] = edge -> vertices[NN_BACKWARD] -> map;
-			new_edges[i].next[NN_FORWARD] = new_edges[i].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-			new_edges[i].next[NN_BACKWARD] = new_edges[i].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-			new_edges[i].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[i],
-			new_edges[i].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[i];
-
-			if (new_edges[i].vertices[NN_BACKWARD] == (& new_vertices[0]))
+			new_edges[i].count = 0,
+			new_edges[i].vertices[NN_FORWARD] = vertices[edge -> vertices[NN_FORWARD]].map,
+			new_edges[i].vertices[NN_BACKWARD] = vertices[edge -> vertices[NN_BACKWARD]].map;
+			NNattach(new_vertices, new_edges, i);
+
+			if (new_edges[i].vertices[NN_BACKWARD] == 0)
 				new_edges[i].value = new_edges[i].weight;
 
 			i++;
 		}
 	}
 
-	if (flag == NNITER_IS_ERROR)
-		goto fail;
-
-	NNfree_iter(iter);
-
 	new -> edges = i;
 
 	for (i = 0; i < v; i++)
-		vertices[i].map = NULL;
+		vertices[i].map = NN_NIL;
 
 	for (i = 0; i < e; i++)
 		edges[i].flag = 0;
 
+	NNinvalidate_schedule(network);
+
 	return new;
 
 fail:
-	if (iter != NULL)
-		NNfree_iter(iter);
-
 	if (new != NULL)
 		NNfree(new);
 
 	for (i = 0; i < v; i++)
-		vertices[i].map = NULL;
+		vertices[i].map = NN_NIL;
 
 	return NULL;
 }
@@ -880,37 +1450,40 @@ struct NNetwork * NNfission(struct NNetwork * network, double reaction_hold) {
 	if ((new = malloc(sizeof(struct NNetwork) + 2 * v * sizeof(struct NNvertex) + 3 * e * sizeof(struct NNedge))) == NULL)
 		return NULL;
 
-	new -> inputs = inputs, new -> outputs = outputs;
+	new -> inputs = inputs, new -> outputs = outputs, new -> schedule = NULL;
 
 	struct NNvertex * vertices = (void *)network -> contents, * new_vertices = (void *)new -> contents, * vertex;
 
 	j = 0;
 	for (i = 0; i < v; i++) {
 
-		new_vertices[j].map = NULL,
-		new_vertices[j].edges[NN_BACKWARD] = NULL,
-		new_vertices[j].edges[NN_FORWARD] = NULL,
+		new_vertices[j].map = NN_NIL,
+		new_vertices[j].edges[NN_BACKWARD] = NN_NIL,
+		new_vertices[j].edges[NN_FORWARD] = NN_NIL,
+		new_vertices[j].d_output = 0,
 		new_vertices[j].derivative = 0,
 		new_vertices[j].layer_index = vertices[i].layer_index,
 		new_vertices[j].activ_index = vertices[i].activ_index,
-		new_vertices[j].activate = vertices[i].activate,
-		new_vertices[j].d_activate = vertices[i].d_activate,
-		new_vertices[j].value = vertices[j].value,
-		new_vertices[j].nuance = vertices[i].nuance;
-		vertices[i].map = &new_vertices[j];
+		new_vertices[j].value = vertices[i].value,
+		new_vertices[j].output = vertices[i].output,
+		new_vertices[j].nuance = vertices[i].nuance,
+		new_vertices[j].count = 0;
+		vertices[i].map = j;
 		j++;
 
 		if ((vertices[i].nuance > reaction_hold) && (i > inputs + outputs)) {
 
-			new_vertices[j].map = & new_vertices[j-1],
-			new_vertices[j].edges[NN_BACKWARD] = NULL,
-			new_vertices[j].edges[NN_FORWARD] = NULL,
+			new_vertices[j].map = j - 1,
+			new_vertices[j].edges[NN_BACKWARD] = NN_NIL,
+			new_vertices[j].edges[NN_FORWARD] = NN_NIL,
+			new_vertices[j].d_output = 0,
 			new_vertices[j].derivative = 0,
 			new_vertices[j].layer_index = vertices[i].layer_index,
 			new_vertices[j].activ_index = vertices[i].activ_index,
-			new_vertices[j].activate = vertices[i].activate,
-			new_vertices[j].d_activate = vertices[i].d_activate,
-			new_vertices[j].nuance = vertices[i].nuance;
+			new_vertices[j].value = vertices[i].value,
+			new_vertices[j].output = vertices[i].output,
+			new_vertices[j].nuance = vertices[i].nuance,
+			new_vertices[j].count = 0;
 			j++;
 		}
 	}
@@ -922,15 +1495,15 @@ struct NNetwork * NNfission(struct NNetwork * network, double reaction_hold) {
 
 		new_edges[k].flag = 0,
 		new_edges[k].weight = edges[k].weight,
+		new_edges[k].value = 0,
+		new_edges[k].derivative = 0,
 		new_edges[k].nuance = edges[k].nuance,
-		new_edges[k].vertices[NN_FORWARD] = edges[k].vertices[NN_FORWARD] -> map,
-		new_edges[k].vertices[NN_BACKWARD] = edges[k].vertices[NN_BACKWARD] -> map;
-		new_edges[k].next[NN_FORWARD] = new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-		new_edges[k].next[NN_BACKWARD] = new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-		new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[k],
-		new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[k];
-			
-		if (new_edges[k].vertices[NN_BACKWARD] == (& new_vertices[0]))
+		new_edges[k].count = 0,
+		new_edges[k].vertices[NN_FORWARD] = vertices[edges[k].vertices[NN_FORWARD]].map,
+		new_edges[k].vertices[NN_BACKWARD] = vertices[edges[k].vertices[NN_BACKWARD]].map;
+		NNattach(new_vertices, new_edges, k);
+
+		if (new_edges[k].vertices[NN_BACKWARD] == 0)
 			new_edges[k].value = new_edges[k].weight;
 	}
 
@@ -938,47 +1511,49 @@ struct NNetwork * NNfission(struct NNetwork * network, double reaction_hold) {
 	v = j; j = k;
 
 	for (i = 0; i < v; i++) {
-		if (new_vertices[i].map != NULL) {
-			vertex = new_vertices[i].map;
-			new_vertices[i].map = NULL;
-			edge = vertex -> edges[NN_BACKWARD];
+		if (new_vertices[i].map != NN_NIL) {
+			vertex = new_vertices + new_vertices[i].map;
+			new_vertices[i].map = NN_NIL;
+			edge = NN_EDGE(new_edges, vertex -> edges[NN_BACKWARD]);
 			while (edge != NULL) {
 
 				new_edges[k].flag = 0,
 				new_edges[k].weight = edge -> weight,
+				new_edges[k].value = 0,
+				new_edges[k].derivative = 0,
 				new_edges[k].nuance = edge -> nuance,
-				new_edges[k].vertices[NN_FORWARD] = & new_vertices[i],
+				new_edges[k].count = 0,
+				new_edges[k].vertices[NN_FORWARD] = i,
 				new_edges[k].vertices[NN_BACKWARD] = edge -> vertices[NN_BACKWARD];
 
 
-				if (new_edges[k].vertices[NN_BACKWARD] == (& new_vertices[0]))
+				if (new_edges[k].vertices[NN_BACKWARD] == 0)
 					new_edges[k].value = new_edges[k].weight;
 
-				edge = edge -> next[NN_BACKWARD];
+				edge = NN_EDGE(new_edges, edge -> next[NN_BACKWARD]);
 				k++;
 			}
 
-			edge = vertex -> edges[NN_FORWARD];
+			edge = NN_EDGE(new_edges, vertex -> edges[NN_FORWARD]);
 			while (edge != NULL) {
 
 				new_edges[k].flag = 0,
 				new_edges[k].weight = edge -> weight,
+				new_edges[k].value = 0,
+				new_edges[k].derivative = 0,
 				new_edges[k].nuance = edge -> nuance,
+				new_edges[k].count = 0,
 				new_edges[k].vertices[NN_FORWARD] = edge -> vertices[NN_FORWARD],
-				new_edges[k].vertices[NN_BACKWARD] = & new_vertices[i];
+				new_edges[k].vertices[NN_BACKWARD] = i;
 
-				edge = edge -> next[NN_BACKWARD];
+				edge = NN_EDGE(new_edges, edge -> next[NN_FORWARD]);
 				k++;
 			}
 		}
 	}
 
-	for (i = j; i < k; i++) {
-		new_edges[i].next[NN_FORWARD] = new_edges[i].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-		new_edges[i].next[NN_BACKWARD] = new_edges[i].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-		new_edges[i].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[i],
-		new_edges[i].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[i];
-	}
+	for (i = j; i < k; i++)
+		NNattach(new_vertices, new_edges, i);
 
 	new -> vertices = v,
 	new -> edges = k;
@@ -999,7 +1574,7 @@ struct NNetwork * NNfission(struct NNetwork * network, double reaction_hold) {
 
 struct NNetwork * NNfusion(struct NNetwork * network, double reaction_hold, double vanish_hold, int activ_index) {
 
-	unsigned int v = network -> vertices, e = network -> edges, mount_size = 0, i, j, k, l, * index = NULL;
+	unsigned int v = network -> vertices, e = network -> edges, mount_size = 0, i, j, k, l, n, * index = NULL;
 
 	struct NNvertex * vertices = (void *) network -> contents, * new_vertices, ** from = NULL, ** to = NULL;
 	struct NNedge * edges = (void *)(vertices + v), * edge, ** transfer = NULL, ** mount = NULL, * new_edges;
@@ -1012,7 +1587,7 @@ struct NNetwork * NNfusion(struct NNetwork * network, double reaction_hold, doub
 
 		transfer[i] = NULL;
 
-		if (edges[i].nuance > reaction_hold && (edges[i].vertices[NN_BACKWARD] != & vertices[0])) {
+		if (edges[i].nuance > reaction_hold && (edges[i].vertices[NN_BACKWARD] != 0)) {
 			//edges[i].flag = 1;
 			transfer[j++] = & edges[i];
 		}
@@ -1032,12 +1607,12 @@ struct NNetwork * NNfusion(struct NNetwork * network, double reaction_hold, doub
 		k = 0, i = 0;
 		mount[j++] = (edge = transfer[0]);
 
-		index[mount_size++] = edge -> vertices[NN_BACKWARD] -> layer_index;
+		index[mount_size++] = vertices[edge -> vertices[NN_BACKWARD]].layer_index;
 
 		while ((transfer[k] = transfer[++i]) != NULL) {
 
-			if ((edge -> vertices[NN_FORWARD] -> layer_index == transfer[i] -> vertices[NN_FORWARD] -> layer_index) && 
-				(edge -> vertices[NN_BACKWARD] -> layer_index == transfer[i] -> vertices[NN_BACKWARD] -> layer_index))
+			if ((vertices[edge -> vertices[NN_FORWARD]].layer_index == vertices[transfer[i] -> vertices[NN_FORWARD]].layer_index) && 
+				(vertices[edge -> vertices[NN_BACKWARD]].layer_index == vertices[transfer[i] -> vertices[NN_BACKWARD]].layer_index))
 				mount[j++] = transfer[i], transfer[k--] = NULL;
 
 			transfer[i] = NULL, k++;
@@ -1056,21 +1631,22 @@ struct NNetwork * NNfusion(struct NNetwork * network, double reaction_hold, doub
 	if ((new = malloc(sizeof(struct NNetwork) + (v + mount_size) * sizeof(struct NNvertex) + (e + 2 * j + mount_size) * sizeof(struct NNedge))) == NULL)
 		goto fail;
 
-	new -> inputs = network -> inputs, new -> outputs = network -> outputs, new -> vertices = v + mount_size;
+	new -> inputs = network -> inputs, new -> outputs = network -> outputs, new -> vertices = v + mount_size, new -> schedule = NULL;
 	new_vertices = (void *)new -> contents, new_edges = (void *)(new_vertices + v + mount_size);
 
 	for (i = 0, j = 0; i < v; i++) {
-		new_vertices[j].map = NULL,
-		new_vertices[j].edges[NN_BACKWARD] = NULL,
-		new_vertices[j].edges[NN_FORWARD] = NULL,
+		new_vertices[j].map = NN_NIL,
+		new_vertices[j].edges[NN_BACKWARD] = NN_NIL,
+		new_vertices[j].edges[NN_FORWARD] = NN_NIL,
+		new_vertices[j].d_output = 0,
 		new_vertices[j].derivative = 0,
 		new_vertices[j].layer_index = vertices[i].layer_index,
 		new_vertices[j].activ_index = vertices[i].activ_index,
-		new_vertices[j].activate = vertices[i].activate,
-		new_vertices[j].d_activate = vertices[i].d_activate,
 		new_vertices[j].value = vertices[i].value,
-		new_vertices[j].nuance = vertices[i].nuance;
-		vertices[i].map = & new_vertices[j];
+		new_vertices[j].output = vertices[i].output,
+		new_vertices[j].nuance = vertices[i].nuance,
+		new_vertices[j].count = 0;
+		vertices[i].map = j;
 
 		if ((l = vertices[i].layer_index) != (unsigned int) -1) {
 			for (k = 0; k < mount_size; k++) {
@@ -1091,54 +1667,60 @@ struct NNetwork * NNfusion(struct NNetwork * network, double reaction_hold, doub
 
 		new_edges[k].flag = 0,
 		new_edges[k].weight = vanish_hold, /* edges[i].weight | NNrand(turbulence) */
+		new_edges[k].value = 0,
+		new_edges[k].derivative = 0,
 		new_edges[k].nuance = edges[i].nuance,
-		new_edges[k].vertices[NN_FORWARD] = edges[i].vertices[NN_FORWARD] -> map,
-		new_edges[k].vertices[NN_BACKWARD] = edges[i].vertices[NN_BACKWARD] -> map;
-		new_edges[k].next[NN_FORWARD] = new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-		new_edges[k].next[NN_BACKWARD] = new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-		new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[k],
-		new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[k];
+		new_edges[k].count = 0,
+		new_edges[k].vertices[NN_FORWARD] = vertices[edges[i].vertices[NN_FORWARD]].map,
+		new_edges[k].vertices[NN_BACKWARD] = vertices[edges[i].vertices[NN_BACKWARD]].map;
+		NNattach(new_vertices, new_edges, k);
+
+		if (new_edges[k].vertices[NN_BACKWARD] == 0)
+			new_edges[k].value = new_edges[k].weight;
 
 		k++;
 	}
 
 	free(index); index = NULL;
 
-	new_vertices += j;
-
 	for (i = 0, l = 0; i < mount_size; i++) {
 
-		new_vertices[i].map = NULL,
-		new_vertices[i].layer_index = mount[l] -> vertices[NN_BACKWARD] -> layer_index + 1,
-		new_vertices[i].activ_index = activ_index,
-		new_vertices[i].activate = activ_table[activ_index],
-		new_vertices[i].d_activate = d_activ_table[activ_index],
-		new_vertices[i].nuance = 0;
+		n = v + i;
+		new_vertices[n].map = NN_NIL,
+		new_vertices[n].edges[NN_BACKWARD] = NN_NIL,
+		new_vertices[n].edges[NN_FORWARD] = NN_NIL,
+		new_vertices[n].layer_index = vertices[mount[l] -> vertices[NN_BACKWARD]].layer_index + 1,
+		new_vertices[n].activ_index = activ_index,
+		new_vertices[n].value = 0,
+		new_vertices[n].output = 0,
+		new_vertices[n].d_output = 0,
+		new_vertices[n].derivative = 0,
+		new_vertices[n].nuance = 0,
+		new_vertices[n].count = 0;
 
 		new_edges[k].flag = 0,
 		new_edges[k].weight = vanish_hold,
 		new_edges[k].value = 0,
+		new_edges[k].derivative = 0,
 		new_edges[k].nuance = 0,
-		new_edges[k].vertices[NN_FORWARD] = & new_vertices[i],
-		new_edges[k].vertices[NN_BACKWARD] = (void *)new -> contents;
-		new_edges[k].next[NN_FORWARD] = new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-		new_edges[k].next[NN_BACKWARD] = new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-		new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[k],
-		new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[k];
+		new_edges[k].count = 0,
+		new_edges[k].vertices[NN_FORWARD] = n,
+		new_edges[k].vertices[NN_BACKWARD] = 0;
+		NNattach(new_vertices, new_edges, k);
 
 		k++;
 
 		j = 0;
 
 		do {
-			from[j] = mount[l] -> vertices[NN_BACKWARD], to[j] = mount[l] -> vertices[NN_FORWARD];
+			from[j] = vertices + mount[l] -> vertices[NN_BACKWARD], to[j] = vertices + mount[l] -> vertices[NN_FORWARD];
 			j++;
 
 			if (mount[++l] == NULL)
 				break;
 
-		} while ((mount[l] -> vertices[NN_BACKWARD] -> layer_index == mount[l - 1] -> vertices[NN_BACKWARD] -> layer_index) && 
-			(mount[l] -> vertices[NN_FORWARD] -> layer_index == mount[l - 1] -> vertices[NN_FORWARD] -> layer_index));
+		} while ((vertices[mount[l] -> vertices[NN_BACKWARD]].layer_index == vertices[mount[l - 1] -> vertices[NN_BACKWARD]].layer_index) && 
+			(vertices[mount[l] -> vertices[NN_FORWARD]].layer_index == vertices[mount[l - 1] -> vertices[NN_FORWARD]].layer_index));
 
 		qsort(from, j, sizeof(struct NNvertex *), & addr_compare),
 		qsort(to, j, sizeof(struct NNvertex *), & addr_compare);
@@ -1149,13 +1731,13 @@ struct NNetwork * NNfusion(struct NNetwork * network, double reaction_hold, doub
 
 				new_edges[k].flag = 0,
 				new_edges[k].weight = vanish_hold,
+				new_edges[k].value = 0,
+				new_edges[k].derivative = 0,
 				new_edges[k].nuance = 0,
-				new_edges[k].vertices[NN_FORWARD] = & new_vertices[i],
+				new_edges[k].count = 0,
+				new_edges[k].vertices[NN_FORWARD] = n,
 				new_edges[k].vertices[NN_BACKWARD] = from[m] -> map;
-				new_edges[k].next[NN_FORWARD] = new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-				new_edges[k].next[NN_BACKWARD] = new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-				new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[k],
-				new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[k];
+				NNattach(new_vertices, new_edges, k);
 
 				k++;
 
@@ -1167,13 +1749,13 @@ struct NNetwork * NNfusion(struct NNetwork * network, double reaction_hold, doub
 
 				new_edges[k].flag = 0,
 				new_edges[k].weight = vanish_hold,
+				new_edges[k].value = 0,
+				new_edges[k].derivative = 0,
 				new_edges[k].nuance = 0,
+				new_edges[k].count = 0,
 				new_edges[k].vertices[NN_FORWARD] = to[m] -> map,
-				new_edges[k].vertices[NN_BACKWARD] = & new_vertices[i];
-				new_edges[k].next[NN_FORWARD] = new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD],
-				new_edges[k].next[NN_BACKWARD] = new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD];
-				new_edges[k].vertices[NN_BACKWARD] -> edges[NN_FORWARD] = & new_edges[k],
-				new_edges[k].vertices[NN_FORWARD] -> edges[NN_BACKWARD] = & new_edges[k];
+				new_edges[k].vertices[NN_BACKWARD] = n;
+				NNattach(new_vertices, new_edges, k);
 
 				k++;	
 
@@ -1243,3 +1825,43 @@ int addr_compare(const void *element1, const void *element2) {
 double NNrand(double lim) {
 	return ((double)rand() / RAND_MAX) * 2 * lim - lim;
 }
+
+
+/*
+	draw from the random generator of a training (splitmix64)
+
+	state -- the state of the generator, advanced
+
+	return the next random number
+*/
+
+uint64_t NNrandom(uint64_t * state) {
+
+	uint64_t z = (* state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+
+/*
+	shuffle the indices of the samples (Fisher-Yates)
+
+	index -- the indices to shuffle
+	size -- the number of indices
+	state -- the state of the random generator, advanced
+*/
+
+void NNshuffle(size_t * index, size_t size, uint64_t * state) {
+
+	size_t i, j, t;
+
+	for (i = size; i > 1; i--) {
+		j = NNrandom(state) % i;
+		t = index[i - 1], index[i - 1] = index[j], index[j] = t;
+	}
+
+	return;
+}
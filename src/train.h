@@ -10,6 +10,12 @@
 #define NNCONTINUE 0
 #define NNTERMINATE -1
 
+#define NN_LINKED 0
+#define NN_CSR 1
+
+#define NN_DOUBLE 0
+#define NN_FLOAT 1
+
 
 struct NNparam;
 
@@ -27,6 +33,21 @@ struct NNparam;
 typedef double (* NNcost)(size_t size, const double * outputs, const double * expects, double * derivatives);
 
 
+/*
+	the source type for streaming the training samples
+
+	context -- the source_context given in struct NNparam
+	rows -- where to store the samples, double[capacity][inputs + outputs]
+	capacity -- the most samples to store
+
+	return the number of samples stored, 0 at the end of a pass over the samples (the next call starts a new pass), -1 on error
+
+	note: the source is called from the prefetch thread of the training, never from two threads at once. It is started with the training and runs across its stages, it may be called for the next pass before the current stage ends.
+*/
+
+typedef long (* NNsource)(void * context, double * rows, size_t capacity);
+
+
 /*
 	the callback function type for each stage of network training
 
@@ -46,33 +67,52 @@ typedef int (* NNcallback)(struct NNetwork * network, double general_cost, struc
 /* 
 	the parameters for training the neural network
 
-	core -- number of forked threads to use in training, 0 for single process.
+	core -- number of threads to use in training, 0 for the calling thread only. The threads are created once for the whole training, each trains a replica of the network on its block of the training set and helps the others with theirs when done. The nuances of the cores are weighted by the samples each one trained, so the update is the mean over all the samples as with 0, whatever the split. With more than one thread the order the nuances are summed in depends on the timing, so runs may differ in the last bits
 	freeze_steps -- number of steps to proceed after the cost is below freeze_hold, ends immediately if less than 1
 	activ_index -- the activation function to use for vertices created in next evolution
 	verbose -- set to 1 for output during training
 	tolerance -- the tolerance step_size, this times of superfluous step would cause step_size to shrink
+	layout -- the adjacency propagation runs on, NN_LINKED (default) walks the edge lists of the network, NN_CSR a compact CSR/CSC structure-of-arrays copy (see NNget_csr) rebuilt after each evolution
+	checkpoint_stages -- write a checkpoint every this many stages, 0 to ignore
+	train_type -- the element type of train_set, NN_DOUBLE (default) or NN_FLOAT
+	test_type -- the element type of test_set, NN_DOUBLE (default) or NN_FLOAT
+	epochs -- with batch_size, the passes over the training set in a stage, 0 to run until frozen (see freeze_steps)
 	eval_cost -- the customerized cost function
 	callback -- the call back function to call after each stage of training
-	train_size -- the entries of training set
+	train_size -- the entries of training set (ignored with source)
 	test_size -- the entries of test set
+	batch_size -- 0 (default) to update the weights once per pass over the whole training set, otherwise the samples per update of mini-batch training. Each pass (epoch) runs over the training set in a new random order drawn from seed, the samples of a batch are split among the cores (unevenly when batch_size does not divide by core, which the weighted reduce makes up for). The step_size halving of a worse round is skipped, and freeze_hold and vanish_hold are checked against the sums over an epoch. Ignored with source
 	step_size -- the variation unit for gd (relatively small value preferred)
 	freeze_hold -- the freeze zone for cost, proceed only freeze_steps more steps while the sum of cost of one batch is less or equal to freeze_hold. If this value is negative, vanish_hold will be used instead.
 	vanish_hold -- This value has to be semi-positive(0 or above), determines whether some value has vanished (less or equal). This value will also use for initialize the network
 	reaction_hold -- the threshold for vertices fission and edges fusion (when general nuance is greater than this value)
+	checkpoint_seconds -- write a checkpoint after a stage when this many seconds passed since the last one, 0 to ignore
 	turbulence (deprecated) -- a tiny random field act on the model's weight (positive value << 1, preferrably vanish_hold < turbulence < freeze_hold)
-	train_set -- the 2-d matrix for training samples in the form double[train_size][inputs + outputs]
-	test_set -- the 2-d matrix for testing samples in the form double[test_size][inputs + outputs]
+	train_set -- the 2-d matrix for training samples in the form double[train_size][inputs + outputs] (float for NN_FLOAT), see NNdataset_bind for a mapped file
+	test_set -- the 2-d matrix for testing samples in the form double[test_size][inputs + outputs] (float for NN_FLOAT)
+	checkpoint -- the filename of the checkpoint, NULL for none. The network of a stage is copied and saved in the binary format on a background thread (see NNcheckpoint_start), training does not wait for the write
+	state -- the filename of the training state, NULL for none. It is written with the checkpoints, after the callback of the stage, and holds everything NNresume needs to continue the training (see NNsave_state)
+	source -- the source of the training samples, read in batches on a prefetch thread instead of train_set, NULL to use train_set. A round of training is one pass of the source, with core > 0 each batch goes to the first core asking for one, a core that got no batch adds nothing to the update
+	source_context -- the argument for source
+	source_batch -- the samples asked from source at a time, 0 for NN_STREAM_BATCH
+	seed -- the seed of the random generator of the training, which reseeds rand() before every stage, 0 to seed from the time
 */
 
 struct NNparam {
-	int core, freeze_steps, activ_index, verbose, tolerance;
+	int core, freeze_steps, activ_index, verbose, tolerance, layout, checkpoint_stages, train_type, test_type, epochs;
 	NNcost eval_cost;
 	NNcallback callback;
-	size_t train_size, test_size;
-	double step_size, freeze_hold, vanish_hold, /*turbulence,*/ reaction_hold, ** train_set, ** test_set;
+	size_t train_size, test_size, batch_size;
+	double step_size, freeze_hold, vanish_hold, /*turbulence,*/ reaction_hold, checkpoint_seconds, ** train_set, ** test_set;
+	const char * checkpoint, * state;
+	NNsource source;
+	void * source_context;
+	size_t source_batch;
+	unsigned long seed;
 };
 
 struct NNetwork * NNtrain(struct NNetwork * network, struct NNparam * param);
+struct NNetwork * NNresume(const char * file, struct NNparam * param);
 
 
 #endif